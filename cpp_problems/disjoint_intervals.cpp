@@ -1,3 +1,10 @@
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include "parallel_for.h"
 #include "template.h"
 #include "test_runner.h"
 
@@ -49,6 +56,654 @@ vector<vector<int>> intervalIntersetions(vector<vector<int>>& list1, vector<vect
     return result;
 }
 
+/*
+Flat interval set: closed intervals [starts[k], ends[k]], sorted and pairwise disjoint, kept as
+two parallel arrays. Because the intervals are disjoint, both arrays are sorted, so either one
+can be binary searched and a block of either one can be compared at once.
+*/
+struct IntervalSet {
+    vector<int> starts;
+    vector<int> ends;
+
+    size_t size() const
+    {
+        return starts.size();
+    }
+
+    void push_back(int start, int end)
+    {
+        starts.push_back(start);
+        ends.push_back(end);
+    }
+
+    bool operator==(const IntervalSet& other) const
+    {
+        return starts == other.starts && ends == other.ends;
+    }
+
+    // Throws invalid_argument unless the lists are well-formed, sorted and disjoint
+    static IntervalSet fromLists(const vector<vector<int>>& lists)
+    {
+        IntervalSet set;
+        set.starts.reserve(lists.size());
+        set.ends.reserve(lists.size());
+        for (const auto& interval : lists) {
+            if (interval.size() != 2 || interval[0] > interval[1]) {
+                throw invalid_argument("Interval must be [start, end] with start <= end");
+            }
+            if (set.size() > 0 && interval[0] <= set.ends.back()) {
+                throw invalid_argument("Intervals must be sorted and disjoint");
+            }
+            set.push_back(interval[0], interval[1]);
+        }
+        return set;
+    }
+
+    vector<vector<int>> toLists() const
+    {
+        vector<vector<int>> lists;
+        lists.reserve(size());
+        for (size_t k = 0; k < size(); ++k) {
+            lists.push_back({starts[k], ends[k]});
+        }
+        return lists;
+    }
+};
+
+// First index in [from, n) whose value is not before(value), for values sorted so that before()
+// holds on a prefix. Steps out exponentially from `from` and then binary searches the last step,
+// so skipping k entries costs O(log k) rather than O(log n).
+template <typename Before>
+size_t gallop(const int* values, size_t from, size_t n, Before before)
+{
+    if (from >= n || !before(values[from])) {
+        return from;
+    }
+    size_t low = from, step = 1; // before(values[low]) holds throughout
+    while (low + step < n && before(values[low + step])) {
+        low += step;
+        step *= 2;
+    }
+    size_t high = min(low + step, n);
+    return upper_bound(values + low + 1, values + high, 0,
+                       [&](int, int value) { return !before(value); }) -
+           values;
+}
+
+// Writes [max(starts[k], lo), min(ends[k], hi)] for k < count
+void clampRunScalar(const int* starts, const int* ends, size_t count, int lo, int hi,
+                    int* outStarts, int* outEnds)
+{
+    for (size_t k = 0; k < count; ++k) {
+        outStarts[k] = max(starts[k], lo);
+        outEnds[k]   = min(ends[k], hi);
+    }
+}
+
+// Length of the run of starts[from ..) that are <= limit
+size_t runLengthScalar(const int* starts, size_t from, size_t n, int limit)
+{
+    return gallop(starts, from, n, [limit](int start) { return start <= limit; }) - from;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) void clampRunAvx2(const int* starts, const int* ends,
+                                                  size_t count, int lo, int hi, int* outStarts,
+                                                  int* outEnds)
+{
+    const __m256i low  = _mm256_set1_epi32(lo);
+    const __m256i high = _mm256_set1_epi32(hi);
+    size_t        k    = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(starts + k));
+        __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ends + k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(outStarts + k), _mm256_max_epi32(s, low));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(outEnds + k), _mm256_min_epi32(e, high));
+    }
+    clampRunScalar(starts + k, ends + k, count - k, lo, hi, outStarts + k, outEnds + k);
+}
+
+// Compares eight starts at a time while the run is short, which is the common case in dense
+// regions; a run that fills whole blocks is finished by galloping
+__attribute__((target("avx2"))) size_t runLengthAvx2(const int* starts, size_t from, size_t n,
+                                                     int limit)
+{
+    const __m256i bound = _mm256_set1_epi32(limit);
+    for (size_t k = from, blocks = 0; k + 8 <= n && blocks < 4; k += 8, ++blocks) {
+        __m256i  s    = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(starts + k));
+        unsigned past = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(s, bound)));
+        if (past != 0) {
+            return k + __builtin_ctz(past) - from;
+        }
+    }
+    return runLengthScalar(starts, from, n, limit);
+}
+#endif
+
+struct IntervalKernels {
+    void (*clampRun)(const int*, const int*, size_t, int, int, int*, int*);
+    size_t (*runLength)(const int*, size_t, size_t, int);
+};
+
+// Chosen once per process: AVX2 where the CPU has it, portable loops elsewhere
+const IntervalKernels& intervalKernels()
+{
+    static const IntervalKernels kernels = [] {
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2")) {
+            return IntervalKernels{clampRunAvx2, runLengthAvx2};
+        }
+#endif
+        return IntervalKernels{clampRunScalar, runLengthScalar};
+    }();
+    return kernels;
+}
+
+/*
+Intersection of two flat sets into `out`, which is resized to the |a| + |b| upper bound once
+and trimmed at the end, so no per-interval allocation happens.
+
+Each step either skips or emits:
+  - When the current interval of one side ends before the other starts, galloping skips every
+    interval of that side that ends too early. Sparse regions are crossed in logarithmic time.
+  - Otherwise the interval that ends later is the outer one. Every interval of the other side
+    that starts by its end overlaps it, and together they form a run. Each run element is
+    clamped to the outer interval and written as one block. Dense regions are processed with
+    vector compares and min/max instead of one branchy step per pair.
+*/
+void intersectInto(const IntervalSet& a, const IntervalSet& b, IntervalSet& out)
+{
+    const IntervalKernels& kernels = intervalKernels();
+    out.starts.resize(a.size() + b.size());
+    out.ends.resize(a.size() + b.size());
+    size_t written = 0;
+
+    const IntervalSet* side[2] = {&a, &b};
+    size_t             pos[2]  = {0, 0};
+    while (pos[0] < a.size() && pos[1] < b.size()) {
+        int start0 = a.starts[pos[0]], end0 = a.ends[pos[0]];
+        int start1 = b.starts[pos[1]], end1 = b.ends[pos[1]];
+        if (end0 < start1) {
+            pos[0] = gallop(a.ends.data(), pos[0], a.size(), [=](int end) { return end < start1; });
+            continue;
+        }
+        if (end1 < start0) {
+            pos[1] = gallop(b.ends.data(), pos[1], b.size(), [=](int end) { return end < start0; });
+            continue;
+        }
+        int                outer = end0 >= end1 ? 0 : 1, inner = 1 - outer;
+        const IntervalSet& in    = *side[inner];
+        int                lo    = outer == 0 ? start0 : start1;
+        int                hi    = outer == 0 ? end0 : end1;
+        size_t             run   = kernels.runLength(in.starts.data(), pos[inner], in.size(), hi);
+        kernels.clampRun(in.starts.data() + pos[inner], in.ends.data() + pos[inner], run, lo, hi,
+                         out.starts.data() + written, out.ends.data() + written);
+        written += run;
+        // The run holds every inner interval overlapping the outer one, so the outer one is done.
+        // Only the last run interval can reach past it, and then it may overlap the next one.
+        pos[inner] += run;
+        pos[outer]++;
+        if (in.ends[pos[inner] - 1] > hi) {
+            pos[inner]--;
+        }
+    }
+    out.starts.resize(written);
+    out.ends.resize(written);
+}
+
+IntervalSet intersect(const IntervalSet& a, const IntervalSet& b)
+{
+    IntervalSet out;
+    intersectInto(a, b, out);
+    return out;
+}
+
+enum class SetOp {
+    Union,        // Points in any set
+    Intersection, // Points in every set
+    Difference    // Points in the first set and in none of the others
+};
+
+// Appends [start, end], merging it into the last interval when they touch or overlap
+void appendMerged(IntervalSet& out, long long start, long long end)
+{
+    if (out.size() > 0 && start <= out.ends.back() + 1LL) {
+        out.ends.back() = int(max<long long>(out.ends.back(), end));
+    } else {
+        out.push_back(int(start), int(end));
+    }
+}
+
+/*
+Tournament (winner) tree over k keyed entries: leaves hold the keys, every internal node holds
+the entry with the smaller key of its two children, and the root is the overall minimum. After
+one key changes only its path to the root is replayed, so each step costs log k comparisons and
+there are no heap swaps.
+*/
+class Tournament
+{
+   public:
+    static constexpr long long done = LLONG_MAX;
+
+    explicit Tournament(size_t count) : leaves_(1)
+    {
+        while (leaves_ < count) {
+            leaves_ *= 2;
+        }
+        keys_.assign(leaves_, done);
+        tree_.assign(2 * leaves_, 0);
+        for (size_t i = 0; i < leaves_; ++i) {
+            tree_[leaves_ + i] = int(i);
+        }
+        for (size_t node = leaves_ - 1; node >= 1; --node) {
+            tree_[node] = better(tree_[2 * node], tree_[2 * node + 1]);
+        }
+    }
+
+    int winner() const
+    {
+        return tree_[1];
+    }
+
+    long long key(int entry) const
+    {
+        return keys_[entry];
+    }
+
+    void update(int entry, long long key)
+    {
+        keys_[entry] = key;
+        for (size_t node = (leaves_ + entry) / 2; node >= 1; node /= 2) {
+            tree_[node] = better(tree_[2 * node], tree_[2 * node + 1]);
+        }
+    }
+
+   private:
+    size_t            leaves_;
+    vector<long long> keys_;
+    vector<int>       tree_; // 1-based
+
+    int better(int left, int right) const
+    {
+        return keys_[right] < keys_[left] ? right : left;
+    }
+};
+
+// Union of sets[first ..) clipped to [lo, hi): a tournament over each set's next start pops the
+// intervals in start order, and overlapping or touching ones are merged on the way out
+IntervalSet unionRange(const vector<IntervalSet>& sets, size_t first, long long lo, long long hi)
+{
+    size_t         k = sets.size() - first;
+    Tournament     tournament(k);
+    vector<size_t> index(k);
+    auto           next = [&](size_t i) {
+        const IntervalSet& set = sets[first + i];
+        return index[i] < set.size() && set.starts[index[i]] < hi
+                   ? max<long long>(set.starts[index[i]], lo)
+                   : Tournament::done;
+    };
+    for (size_t i = 0; i < k; ++i) {
+        const IntervalSet& set = sets[first + i];
+        index[i] = lower_bound(set.ends.begin(), set.ends.end(), lo) - set.ends.begin();
+        tournament.update(int(i), next(i));
+    }
+
+    IntervalSet out;
+    for (int i = tournament.winner(); tournament.key(i) != Tournament::done;
+         i   = tournament.winner()) {
+        long long end = min<long long>(sets[first + i].ends[index[i]], hi - 1);
+        appendMerged(out, tournament.key(i), end);
+        index[i]++;
+        tournament.update(i, next(i));
+    }
+    return out;
+}
+
+// Intersection clipped to [lo, hi). Every point below p is settled, and p only moves forward.
+// The tournament is keyed by the end of each set's current interval. When p is no later than
+// the smallest end, every current interval contains [p, smallest end], so that range is
+// emitted. Otherwise the set with the smallest end gallops to its first interval ending at or
+// after p. Each step costs log k and moves one set forward, so sets far from the output are
+// skipped in long jumps.
+IntervalSet intersectionRange(const vector<IntervalSet>& sets, long long lo, long long hi)
+{
+    const size_t   k = sets.size();
+    Tournament     byEnd(k);
+    vector<size_t> index(k);
+    IntervalSet    out;
+    long long      p = lo;
+    for (size_t i = 0; i < k; ++i) {
+        const IntervalSet& set = sets[i];
+        index[i] = lower_bound(set.ends.begin(), set.ends.end(), lo) - set.ends.begin();
+        if (index[i] == set.size()) {
+            return out;
+        }
+        p = max<long long>(p, set.starts[index[i]]);
+        byEnd.update(int(i), set.ends[index[i]]);
+    }
+    while (p < hi) {
+        int                i   = byEnd.winner();
+        long long          end = byEnd.key(i);
+        const IntervalSet& set = sets[i];
+        if (p <= end) {
+            appendMerged(out, p, min(end, hi - 1));
+            p = end + 1;
+        }
+        index[i] = gallop(set.ends.data(), index[i], set.size(), [p](int e) { return e < p; });
+        if (index[i] == set.size()) {
+            break;
+        }
+        p = max<long long>(p, set.starts[index[i]]);
+        byEnd.update(i, set.ends[index[i]]);
+    }
+    return out;
+}
+
+// sets[0] minus the union of the others, clipped to [lo, hi)
+IntervalSet differenceRange(const vector<IntervalSet>& sets, long long lo, long long hi)
+{
+    const IntervalSet& base  = sets[0];
+    IntervalSet        minus = unionRange(sets, 1, lo, hi);
+    IntervalSet        out;
+    size_t             j = 0;
+    size_t             k = lower_bound(base.ends.begin(), base.ends.end(), lo) - base.ends.begin();
+    for (; k < base.size() && base.starts[k] < hi; ++k) {
+        long long from = max<long long>(base.starts[k], lo);
+        long long to   = min<long long>(base.ends[k], hi - 1);
+        j = gallop(minus.ends.data(), j, minus.size(), [from](int end) { return end < from; });
+        for (; from <= to; ++j) {
+            if (j == minus.size() || minus.starts[j] > to) {
+                appendMerged(out, from, to);
+                break;
+            }
+            if (minus.starts[j] > from) {
+                appendMerged(out, from, minus.starts[j] - 1LL);
+            }
+            from = minus.ends[j] + 1LL;
+            if (minus.ends[j] > to) {
+                break; // It may cover the next base interval too
+            }
+        }
+    }
+    return out;
+}
+
+IntervalSet combineRange(const vector<IntervalSet>& sets, SetOp op, long long lo, long long hi)
+{
+    if (op == SetOp::Union) {
+        return unionRange(sets, 0, lo, hi);
+    }
+    return op == SetOp::Intersection ? intersectionRange(sets, lo, hi)
+                                     : differenceRange(sets, lo, hi);
+}
+
+/*
+k-way union, intersection or difference of sorted disjoint interval sets, each in one pass over
+all sets together rather than pairwise. The result is maximal intervals: touching or
+overlapping pieces are merged.
+
+With threads > 1 the coordinate range is cut at quantiles of a sample of interval starts, and
+each thread sweeps one slice with every cursor clipped to it. A slice result that runs up to
+the cut is then joined with a next slice that starts at the cut.
+*/
+IntervalSet combine(const vector<IntervalSet>& sets, SetOp op, size_t threads = 1)
+{
+    if (sets.empty() && op != SetOp::Union) {
+        throw invalid_argument("Intersection and difference need at least one set");
+    }
+    const long long lo = INT_MIN, hi = INT_MAX + 1LL;
+    if (threads <= 1) {
+        return combineRange(sets, op, lo, hi);
+    }
+
+    vector<long long> sample;
+    for (const IntervalSet& set : sets) {
+        for (size_t k = 0; k < set.size(); k += max<size_t>(1, set.size() / (16 * threads))) {
+            sample.push_back(set.starts[k]);
+        }
+    }
+    sort(sample.begin(), sample.end());
+    vector<long long> cuts = {lo};
+    for (size_t t = 1; t < threads && !sample.empty(); ++t) {
+        long long cut = sample[t * sample.size() / threads];
+        if (cut > cuts.back()) {
+            cuts.push_back(cut);
+        }
+    }
+    cuts.push_back(hi);
+
+    vector<IntervalSet> slices(cuts.size() - 1);
+    parallelFor(slices.size(), [&](size_t t) {
+        slices[t] = combineRange(sets, op, cuts[t], cuts[t + 1]);
+    });
+
+    IntervalSet out;
+    size_t      total = 0;
+    for (const IntervalSet& slice : slices) {
+        total += slice.size();
+    }
+    out.starts.reserve(total);
+    out.ends.reserve(total);
+    for (const IntervalSet& slice : slices) {
+        for (size_t k = 0; k < slice.size(); ++k) {
+            if (out.size() > 0 && out.ends.back() + 1LL == slice.starts[k]) {
+                out.ends.back() = slice.ends[k]; // Stitch across the cut
+            } else {
+                out.push_back(slice.starts[k], slice.ends[k]);
+            }
+        }
+    }
+    return out;
+}
+
+/*
+Mutable collection of closed intervals, which unlike IntervalSet may overlap, for windows that
+open and close during the day. It is a treap ordered by (start, id). Each node also stores the
+largest end in its subtree, so a query skips every subtree whose intervals all end before the
+query range.
+
+Nodes live in one pool vector and link by index, so there is no allocation per interval and
+erased slots are reused. An interval's id is its slot, which stays valid until it is erased.
+*/
+class IntervalTree
+{
+   public:
+    using Id = uint32_t;
+
+    IntervalTree() : root_(nil), size_(0), seed_(0x9e3779b9u) {}
+
+    // Throws invalid_argument if start > end
+    Id insert(int start, int end)
+    {
+        if (start > end) {
+            throw invalid_argument("Interval must have start <= end");
+        }
+        Id id;
+        if (!free_.empty()) {
+            id = free_.back();
+            free_.pop_back();
+        } else {
+            id = Id(nodes_.size());
+            nodes_.emplace_back();
+        }
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 17;
+        seed_ ^= seed_ << 5;
+        nodes_[id] = {start, end, end, seed_, nil, nil, true};
+        auto [left, right] = split(root_, start, id);
+        root_              = merge(merge(left, id), right);
+        size_++;
+        return id;
+    }
+
+    // False if id is not a live interval
+    bool erase(Id id)
+    {
+        if (id >= nodes_.size() || !nodes_[id].alive) {
+            return false;
+        }
+        auto [left, rest] = split(root_, nodes_[id].start, id);
+        root_             = merge(left, split(rest, nodes_[id].start, id + 1).second);
+        nodes_[id].alive  = false;
+        free_.push_back(id);
+        size_--;
+        return true;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    pair<int, int> interval(Id id) const
+    {
+        return {nodes_[id].start, nodes_[id].end};
+    }
+
+    // Appends the ids of intervals that overlap [lo, hi], in start order
+    void overlapping(int lo, int hi, vector<Id>& out) const
+    {
+        collect(root_, lo, hi, out);
+    }
+
+    // Appends the ids of intervals that contain point, in start order
+    void stab(int point, vector<Id>& out) const
+    {
+        collect(root_, point, point, out);
+    }
+
+    // Whether any interval contains point, along a single root-to-leaf path. Going left is safe
+    // whenever the left subtree reaches point: if none of its intervals contains point, the
+    // one ending last starts after it, and so does everything further right.
+    bool contains(int point) const
+    {
+        Id node = root_;
+        while (node != nil && nodes_[node].maxEnd >= point) {
+            const Node& n = nodes_[node];
+            if (n.left != nil && nodes_[n.left].maxEnd >= point) {
+                node = n.left;
+            } else if (n.start > point) {
+                return false;
+            } else if (n.end >= point) {
+                return true;
+            } else {
+                node = n.right;
+            }
+        }
+        return false;
+    }
+
+    // Maximal intervals covered by at least one interval
+    IntervalSet coverage() const
+    {
+        IntervalSet out;
+        walk(root_, [&](const Node& n) { appendMerged(out, n.start, n.end); });
+        return out;
+    }
+
+    static IntervalTree fromSet(const IntervalSet& set)
+    {
+        IntervalTree tree;
+        tree.nodes_.reserve(set.size());
+        for (size_t k = 0; k < set.size(); ++k) {
+            tree.insert(set.starts[k], set.ends[k]);
+        }
+        return tree;
+    }
+
+   private:
+    static constexpr Id nil = UINT32_MAX;
+
+    struct Node {
+        int      start;
+        int      end;
+        int      maxEnd; // Largest end in this subtree
+        uint32_t priority;
+        Id       left;
+        Id       right;
+        bool     alive;
+    };
+
+    vector<Node> nodes_;
+    vector<Id>   free_;
+    Id           root_;
+    size_t       size_;
+    uint32_t     seed_;
+
+    void update(Id node)
+    {
+        Node& n  = nodes_[node];
+        n.maxEnd = n.end;
+        if (n.left != nil) {
+            n.maxEnd = max(n.maxEnd, nodes_[n.left].maxEnd);
+        }
+        if (n.right != nil) {
+            n.maxEnd = max(n.maxEnd, nodes_[n.right].maxEnd);
+        }
+    }
+
+    // Splits into keys below (start, id) and keys at or above it
+    pair<Id, Id> split(Id node, int start, Id id)
+    {
+        if (node == nil) {
+            return {nil, nil};
+        }
+        Node& n = nodes_[node];
+        if (make_pair(n.start, node) < make_pair(start, id)) {
+            auto [left, right] = split(n.right, start, id);
+            nodes_[node].right = left;
+            update(node);
+            return {node, right};
+        }
+        auto [left, right] = split(n.left, start, id);
+        nodes_[node].left  = right;
+        update(node);
+        return {left, node};
+    }
+
+    // Joins two treaps where every key of a is below every key of b
+    Id merge(Id a, Id b)
+    {
+        if (a == nil || b == nil) {
+            return a == nil ? b : a;
+        }
+        if (nodes_[a].priority > nodes_[b].priority) {
+            nodes_[a].right = merge(nodes_[a].right, b);
+            update(a);
+            return a;
+        }
+        nodes_[b].left = merge(a, nodes_[b].left);
+        update(b);
+        return b;
+    }
+
+    void collect(Id node, int lo, int hi, vector<Id>& out) const
+    {
+        if (node == nil || nodes_[node].maxEnd < lo) {
+            return;
+        }
+        const Node& n = nodes_[node];
+        collect(n.left, lo, hi, out);
+        if (n.start > hi) {
+            return; // Everything to the right starts later still
+        }
+        if (n.end >= lo) {
+            out.push_back(node);
+        }
+        collect(n.right, lo, hi, out);
+    }
+
+    template <typename Visit>
+    void walk(Id node, Visit visit) const
+    {
+        if (node != nil) {
+            walk(nodes_[node].left, visit);
+            visit(nodes_[node]);
+            walk(nodes_[node].right, visit);
+        }
+    }
+};
+
 // list1 = [[1, 3], [5, 6], [7, 9]]
 // list2 = [[2, 3], [5, 7]]
 // result = [2, 3], [5, 6], [7, 7]
@@ -98,6 +753,210 @@ void testEmptyList2()
         intervalIntersetions(list1, list2);
 }
 
+// Sorted disjoint intervals with random gaps and lengths in [1, maxGap] and [0, maxLength]
+IntervalSet randomIntervals(size_t count, int maxGap, int maxLength, int first, unsigned seed)
+{
+    mt19937     rng(seed);
+    IntervalSet set;
+    long long   next = first;
+    for (size_t k = 0; k < count; ++k) {
+        long long start = next + rng() % maxGap;
+        long long end   = start + rng() % (maxLength + 1);
+        if (end > INT_MAX) {
+            break;
+        }
+        set.push_back(int(start), int(end));
+        next = end + 1;
+    }
+    return set;
+}
+
+void testFlatIntersectionMatchesPairwise()
+{
+    // Sparse against dense, nested, equal densities, and coordinates at both int limits
+    const int shapes[][3] = {{1000, 5, 0}, {3, 2, 0}, {50, 400, 0}, {10, 10, 0},
+                             {2, 1, INT_MIN}, {4, 3, INT_MAX - 3000}};
+    for (unsigned seed = 1; seed <= 6; ++seed) {
+        for (const auto& left : shapes) {
+            for (const auto& right : shapes) {
+                IntervalSet a = randomIntervals(300, left[0], left[1], left[2], seed);
+                IntervalSet b = randomIntervals(300, right[0], right[1], right[2], seed + 100);
+                auto        listA = a.toLists(), listB = b.toLists();
+                customAssert(intersect(a, b).toLists() == intervalIntersetions(listA, listB));
+                customAssert(intersect(b, a) == intersect(a, b));
+            }
+        }
+    }
+}
+
+void testIntervalKernelsAgree()
+{
+    IntervalSet set = randomIntervals(200, 4, 3, -50, 7);
+    for (size_t from = 0; from < set.size(); from += 13) {
+        for (int limit : {set.starts[from], set.starts[from] + 20, set.starts[from] + 500}) {
+            size_t run = runLengthScalar(set.starts.data(), from, set.size(), limit);
+            customAssert(run == intervalKernels().runLength(set.starts.data(), from, set.size(),
+                                                            limit));
+            vector<int> s1(run), e1(run), s2(run), e2(run);
+            clampRunScalar(&set.starts[from], &set.ends[from], run, limit - 30, limit, s1.data(),
+                           e1.data());
+            intervalKernels().clampRun(&set.starts[from], &set.ends[from], run, limit - 30, limit,
+                                       s2.data(), e2.data());
+            customAssert(s1 == s2 && e1 == e2);
+        }
+    }
+}
+
+void testIntervalSetValidates()
+{
+    customAssert(IntervalSet::fromLists({{1, 3}, {5, 6}}).toLists() ==
+                 vector<vector<int>>({{1, 3}, {5, 6}}));
+    int failures = 0;
+    for (auto lists : {vector<vector<int>>{{3, 1}}, vector<vector<int>>{{1, 3}, {3, 4}},
+                       vector<vector<int>>{{5, 6}, {1, 2}}, vector<vector<int>>{{1}}}) {
+        try {
+            IntervalSet::fromLists(lists);
+        } catch (const invalid_argument&) {
+            failures++;
+        }
+    }
+    customAssert(failures == 4);
+}
+
+// Maximal intervals of a point mask over [offset, offset + mask.size())
+IntervalSet fromMask(const vector<char>& mask, int offset)
+{
+    IntervalSet set;
+    for (size_t x = 0; x < mask.size(); ++x) {
+        if (!mask[x]) {
+            continue;
+        }
+        if (set.size() > 0 && set.ends.back() == int(x) + offset - 1) {
+            set.ends.back()++;
+        } else {
+            set.push_back(int(x) + offset, int(x) + offset);
+        }
+    }
+    return set;
+}
+
+void testCombineMatchesPointSets()
+{
+    for (unsigned seed = 1; seed <= 20; ++seed) {
+        size_t              k = 1 + seed % 7;
+        vector<IntervalSet> sets;
+        vector<vector<char>> masks;
+        for (size_t i = 0; i < k; ++i) {
+            sets.push_back(randomIntervals(40, 1 + (seed + i) % 9, (seed * i) % 12, -20,
+                                           seed * 31 + i));
+            masks.emplace_back(1000, 0);
+            for (size_t j = 0; j < sets[i].size(); ++j) {
+                for (int x = sets[i].starts[j]; x <= sets[i].ends[j] && x + 20 < 1000; ++x) {
+                    masks[i][x + 20] = 1;
+                }
+            }
+        }
+        vector<char> any(1000, 0), all(1000, 1), firstOnly(masks[0]);
+        for (size_t i = 0; i < k; ++i) {
+            for (int x = 0; x < 1000; ++x) {
+                any[x] |= masks[i][x];
+                all[x] &= masks[i][x];
+                firstOnly[x] &= i == 0 || !masks[i][x];
+            }
+        }
+        for (size_t threads : {1, 2, 3, 8}) {
+            customAssert(combine(sets, SetOp::Union, threads) == fromMask(any, -20));
+            customAssert(combine(sets, SetOp::Intersection, threads) == fromMask(all, -20));
+            customAssert(combine(sets, SetOp::Difference, threads) == fromMask(firstOnly, -20));
+        }
+    }
+}
+
+void testCombineEdgeCases()
+{
+    // Touching intervals merge; coordinates at both int limits survive the one-past-end events
+    IntervalSet low  = IntervalSet::fromLists({{INT_MIN, INT_MIN + 2}, {INT_MIN + 3, 0}});
+    IntervalSet high = IntervalSet::fromLists({{1, 5}, {INT_MAX - 1, INT_MAX}});
+    customAssert(combine({low, high}, SetOp::Union).toLists() ==
+                 vector<vector<int>>({{INT_MIN, 5}, {INT_MAX - 1, INT_MAX}}));
+    customAssert(combine({high, low}, SetOp::Difference, 4) == high);
+    customAssert(combine({high, high, high}, SetOp::Intersection, 2) == high);
+    customAssert(combine({}, SetOp::Union).size() == 0);
+    customAssert(combine({high, IntervalSet()}, SetOp::Intersection).size() == 0);
+    bool threw = false;
+    try {
+        combine({}, SetOp::Intersection);
+    } catch (const invalid_argument&) {
+        threw = true;
+    }
+    customAssert(threw);
+}
+
+void testIntervalTreeMatchesBruteForce()
+{
+    mt19937                             rng(17);
+    IntervalTree                        tree;
+    vector<pair<IntervalTree::Id, pii>> live;
+    for (int step = 0; step < 4000; ++step) {
+        int op = rng() % 10;
+        if (op < 5 || live.empty()) {
+            int start = int(rng() % 2000) - 1000, end = start + int(rng() % 60);
+            live.push_back({tree.insert(start, end), {start, end}});
+        } else if (op < 8) {
+            size_t victim = rng() % live.size();
+            customAssert(tree.erase(live[victim].first));
+            customAssert(!tree.erase(live[victim].first));
+            live.erase(live.begin() + victim);
+        } else {
+            int                      lo = int(rng() % 2200) - 1100, hi = lo + int(rng() % 3) * 20;
+            vector<IntervalTree::Id> got, expected;
+            tree.overlapping(lo, hi, got);
+            for (const auto& [id, interval] : live) {
+                if (interval.first <= hi && lo <= interval.second) {
+                    expected.push_back(id);
+                }
+            }
+            sort(got.begin(), got.end());
+            sort(expected.begin(), expected.end());
+            customAssert(got == expected);
+            customAssert(tree.contains(lo) == any_of(live.begin(), live.end(), [lo](auto& e) {
+                             return e.second.first <= lo && lo <= e.second.second;
+                         }));
+        }
+        customAssert(tree.size() == live.size());
+    }
+
+    vector<IntervalSet> singles;
+    for (const auto& [id, interval] : live) {
+        customAssert(tree.interval(id) == interval);
+        singles.push_back(IntervalSet::fromLists({{interval.first, interval.second}}));
+    }
+    customAssert(tree.coverage() == combine(singles, SetOp::Union));
+}
+
+void testIntervalTreeStabbing()
+{
+    IntervalSet              sessions = IntervalSet::fromLists({{0, 10}, {20, 30}});
+    IntervalTree             tree     = IntervalTree::fromSet(sessions);
+    IntervalTree::Id         halt     = tree.insert(5, 25); // Overlaps both
+    vector<IntervalTree::Id> hits;
+    tree.stab(7, hits);
+    customAssert(hits.size() == 2 && hits[1] == halt); // In start order
+    hits.clear();
+    tree.stab(15, hits);
+    customAssert(hits == vector<IntervalTree::Id>({halt}));
+    customAssert(tree.erase(halt) && !tree.contains(15) && tree.contains(INT_MIN) == false);
+    customAssert(tree.insert(INT_MIN, INT_MAX) == halt); // Slot reused
+    customAssert(tree.contains(INT_MIN) && tree.contains(INT_MAX));
+    bool threw = false;
+    try {
+        tree.insert(3, 2);
+    } catch (const invalid_argument&) {
+        threw = true;
+    }
+    customAssert(threw);
+}
+
 // Testing function runner
 void runTests()
 {
@@ -108,6 +967,15 @@ void runTests()
     testResults.push_back(runTest("testDisjoint", testDisjoint));
     testResults.push_back(runTest("testGiantIntervalForList1", testGiantIntervalForList1));
     testResults.push_back(runTest("testEmptyList2", testEmptyList2));
+    testResults.push_back(
+        runTest("testFlatIntersectionMatchesPairwise", testFlatIntersectionMatchesPairwise));
+    testResults.push_back(runTest("testIntervalKernelsAgree", testIntervalKernelsAgree));
+    testResults.push_back(runTest("testIntervalSetValidates", testIntervalSetValidates));
+    testResults.push_back(runTest("testCombineMatchesPointSets", testCombineMatchesPointSets));
+    testResults.push_back(runTest("testCombineEdgeCases", testCombineEdgeCases));
+    testResults.push_back(
+        runTest("testIntervalTreeMatchesBruteForce", testIntervalTreeMatchesBruteForce));
+    testResults.push_back(runTest("testIntervalTreeStabbing", testIntervalTreeStabbing));
 
     // Print test results
     for (const auto& result : testResults) {
@@ -115,8 +983,120 @@ void runTests()
     }
 }
 
-int main()
+// Pairwise vector-of-vectors intersection against the flat kernel, for a few density mixes
+void benchmark(size_t count)
 {
+    struct Scenario {
+        const char* name;
+        int         gapA, lengthA, gapB, lengthB;
+    };
+    const Scenario scenarios[] = {{"similar density", 10, 10, 10, 10},
+                                  {"sparse blackouts", 10, 10, 20000, 50},
+                                  {"wide sessions", 3, 2, 5, 400}};
+    for (const Scenario& scenario : scenarios) {
+        IntervalSet a = randomIntervals(count, scenario.gapA, scenario.lengthA, 0, 1);
+        IntervalSet b = randomIntervals(count, scenario.gapB, scenario.lengthB, 0, 2);
+        auto        listA = a.toLists(), listB = b.toLists();
+
+        auto   start    = chrono::steady_clock::now();
+        size_t pairwise = intervalIntersetions(listA, listB).size();
+        double seconds  = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        IntervalSet out;
+        intersectInto(a, b, out); // Warm the output capacity, as a reused buffer would be
+        start           = chrono::steady_clock::now();
+        intersectInto(a, b, out);
+        double flat = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << scenario.name << ": " << out.size() << " intersections (pairwise " << pairwise
+             << "), pairwise ms " << seconds * 1e3 << ", flat ms " << flat * 1e3 << endl;
+    }
+}
+
+// One k-way sweep per operation against folding the sets pairwise with intersectInto
+void benchmarkCombine(size_t sets, size_t count, size_t threads)
+{
+    vector<IntervalSet> calendars;
+    for (size_t i = 0; i < sets; ++i) {
+        calendars.push_back(randomIntervals(count, 3, 300, 0, unsigned(i + 1)));
+    }
+    const pair<SetOp, const char*> ops[] = {
+        {SetOp::Union, "union"}, {SetOp::Intersection, "intersection"},
+        {SetOp::Difference, "difference"}};
+    for (const auto& op : ops) {
+        for (size_t workers : {size_t(1), threads}) {
+            auto        start   = chrono::steady_clock::now();
+            IntervalSet result  = combine(calendars, op.first, workers);
+            double      seconds = chrono::duration<double>(chrono::steady_clock::now() - start)
+                                 .count();
+            cout << op.second << ", " << workers << " threads: " << result.size()
+                 << " intervals, ms " << seconds * 1e3 << endl;
+        }
+    }
+
+    auto        start = chrono::steady_clock::now();
+    IntervalSet folded = calendars[0], next;
+    for (size_t i = 1; i < sets; ++i) {
+        intersectInto(folded, calendars[i], next);
+        swap(folded, next);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "pairwise intersection fold: " << folded.size() << " intervals, ms " << seconds * 1e3
+         << endl;
+}
+
+// Churn of window inserts and erases with per-order stabbing queries on a day-long time axis
+void benchmarkTree(size_t windows, size_t queries)
+{
+    mt19937                  rng(9);
+    const int                day = 86400000; // Milliseconds
+    IntervalTree             tree;
+    vector<IntervalTree::Id> ids;
+    auto                     start = chrono::steady_clock::now();
+    for (size_t k = 0; k < windows; ++k) {
+        int open = rng() % day;
+        ids.push_back(tree.insert(open, open + int(rng() % 60000)));
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "windows: " << windows << ", insert ns: " << seconds * 1e9 / windows << endl;
+
+    size_t hits = 0, found = 0;
+    start       = chrono::steady_clock::now();
+    vector<IntervalTree::Id> out;
+    for (size_t q = 0; q < queries; ++q) {
+        if (q % 10 == 0) { // Replace a window every tenth order
+            size_t slot = rng() % ids.size();
+            tree.erase(ids[slot]);
+            int open  = rng() % day;
+            ids[slot] = tree.insert(open, open + int(rng() % 60000));
+        }
+        int t = rng() % day;
+        found += tree.contains(t);
+        out.clear();
+        tree.stab(t, out);
+        hits += out.size();
+    }
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "queries: " << queries << ", ns per order (contains + stab, 10% churn): "
+         << seconds * 1e9 / queries << ", windows per stab: " << double(hits) / queries
+         << ", inside any: " << double(found) / queries << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        benchmark(argc > 2 ? stoull(argv[2]) : 5000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-combine") {
+        size_t threads = argc > 4 ? stoull(argv[4]) : max(1u, thread::hardware_concurrency());
+        benchmarkCombine(argc > 2 ? stoull(argv[2]) : 200, argc > 3 ? stoull(argv[3]) : 50000,
+                         threads);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-tree") {
+        benchmarkTree(argc > 2 ? stoull(argv[2]) : 100000, argc > 3 ? stoull(argv[3]) : 1000000);
+        return 0;
+    }
     runTests();
 
     return 0;
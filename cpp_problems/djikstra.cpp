@@ -1,63 +1,1499 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
 #include <vector>
+#include "parallel_for.h"
 #include "test_runner.h"
 
 using namespace std;
 
-const int INF = numeric_limits<int>::max();
+// Path lengths are 64-bit so long routes over large 32-bit weights cannot overflow
+using Distance = int64_t;
 
+const Distance INF = numeric_limits<Distance>::max();
+
+enum class HeapKind {
+    Binary, // std::priority_queue, stale entries skipped on pop
+    DAry,   // 4-ary heap with decrease-key, one entry per vertex
+    Radix   // Radix heap, integer keys only, amortized O(log C) per operation
+};
+
+struct ShortestPaths {
+    vector<Distance> dist;   // INF where unreachable
+    vector<int>      parent; // Predecessor on a shortest path, -1 for the source and unreachable
+
+    // Vertices from the source to target, empty if target is unreachable
+    vector<int> path(int target) const
+    {
+        vector<int> path;
+        if (dist[target] == INF) {
+            return path;
+        }
+        for (int v = target; v != -1; v = parent[v]) {
+            path.push_back(v);
+        }
+        reverse(path.begin(), path.end());
+        return path;
+    }
+};
+
+// Min-heap of vertices with 4 children per node. pos_ tracks where each vertex sits, so
+// lowering a key moves the existing entry instead of pushing a duplicate.
+class DaryHeap
+{
+   public:
+    explicit DaryHeap(int vertices) : pos_(vertices, -1) {}
+
+    bool empty() const
+    {
+        return heap_.empty();
+    }
+
+    // Insert v, or lower its key if it is already queued
+    void push(Distance key, int v)
+    {
+        if (pos_[v] < 0) {
+            pos_[v] = heap_.size();
+            heap_.push_back({key, v});
+        } else {
+            heap_[pos_[v]].key = key;
+        }
+        siftUp(pos_[v]);
+    }
+
+    pair<Distance, int> pop()
+    {
+        Entry top   = heap_[0];
+        pos_[top.v] = -2; // Settled, never queued again
+        Entry last  = heap_.back();
+        heap_.pop_back();
+        if (!heap_.empty()) {
+            heap_[0]     = last;
+            pos_[last.v] = 0;
+            siftDown(0);
+        }
+        return {top.key, top.v};
+    }
+
+   private:
+    struct Entry {
+        Distance key;
+        int      v;
+    };
+
+    static const int arity = 4;
+    vector<Entry>    heap_;
+    vector<int>      pos_; // Index in heap_, -1 never queued, -2 popped
+
+    void siftUp(size_t i)
+    {
+        Entry entry = heap_[i];
+        while (i > 0) {
+            size_t parent = (i - 1) / arity;
+            if (heap_[parent].key <= entry.key) {
+                break;
+            }
+            heap_[i]         = heap_[parent];
+            pos_[heap_[i].v] = i;
+            i                = parent;
+        }
+        heap_[i]      = entry;
+        pos_[entry.v] = i;
+    }
+
+    void siftDown(size_t i)
+    {
+        Entry entry = heap_[i];
+        while (true) {
+            size_t first = i * arity + 1;
+            if (first >= heap_.size()) {
+                break;
+            }
+            size_t best = first;
+            size_t last = min(first + arity, heap_.size());
+            for (size_t c = first + 1; c < last; ++c) {
+                if (heap_[c].key < heap_[best].key) {
+                    best = c;
+                }
+            }
+            if (heap_[best].key >= entry.key) {
+                break;
+            }
+            heap_[i]         = heap_[best];
+            pos_[heap_[i].v] = i;
+            i                = best;
+        }
+        heap_[i]      = entry;
+        pos_[entry.v] = i;
+    }
+};
+
+// Monotone priority queue for integer keys: every popped key is at least the last one popped,
+// which Dijkstra guarantees. Bucket i holds keys whose highest bit differing from the last
+// popped key is bit i - 1, so each entry moves to lower buckets at most 64 times overall.
+class RadixHeap
+{
+   public:
+    RadixHeap() : last_(0), size_(0) {}
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    // Empty the heap for a new search, keeping bucket capacity
+    void clear()
+    {
+        for (auto& bucket : buckets_) {
+            bucket.clear();
+        }
+        last_ = 0;
+        size_ = 0;
+    }
+
+    void push(Distance key, int v)
+    {
+        buckets_[bucketOf(key)].push_back({uint64_t(key), v});
+        size_++;
+    }
+
+    pair<Distance, int> pop()
+    {
+        if (buckets_[0].empty()) {
+            // Redistribute the first non-empty bucket around its minimum
+            size_t i = 1;
+            while (buckets_[i].empty()) {
+                ++i;
+            }
+            uint64_t minKey = buckets_[i][0].key;
+            for (const Entry& entry : buckets_[i]) {
+                minKey = min(minKey, entry.key);
+            }
+            last_ = minKey;
+            for (const Entry& entry : buckets_[i]) {
+                buckets_[bucketOf(entry.key)].push_back(entry);
+            }
+            buckets_[i].clear();
+        }
+        Entry entry = buckets_[0].back();
+        buckets_[0].pop_back();
+        size_--;
+        return {Distance(entry.key), entry.v};
+    }
+
+   private:
+    struct Entry {
+        uint64_t key;
+        int      v;
+    };
+
+    vector<Entry> buckets_[65];
+    uint64_t      last_;
+    size_t        size_;
+
+    size_t bucketOf(Distance key) const
+    {
+        uint64_t diff = uint64_t(key) ^ last_;
+        return diff == 0 ? 0 : 64 - __builtin_clzll(diff);
+    }
+};
+
+// Priority queue over the standard library heap, duplicates allowed
+class BinaryHeap
+{
+   public:
+    bool empty() const
+    {
+        return heap_.empty();
+    }
+    void push(Distance key, int v)
+    {
+        heap_.emplace(key, v);
+    }
+    pair<Distance, int> pop()
+    {
+        pair<Distance, int> top = heap_.top();
+        heap_.pop();
+        return top;
+    }
+
+   private:
+    priority_queue<pair<Distance, int>, vector<pair<Distance, int>>, greater<pair<Distance, int>>>
+        heap_;
+};
+
+// Spinlocks striped over vertices, guarding the (dist, parent) pair during parallel relaxation
+class StripedLocks
+{
+   public:
+    void lock(int v)
+    {
+        atomic_flag& flag = flags_[v & mask];
+        while (flag.test_and_set(memory_order_acquire)) {
+            while (flag.test(memory_order_relaxed)) {
+            }
+        }
+    }
+
+    void unlock(int v)
+    {
+        flags_[v & mask].clear(memory_order_release);
+    }
+
+   private:
+    static const int mask = 4095;
+    atomic_flag      flags_[mask + 1]; // Clear on construction since C++20
+};
+
+// Distance array that is reset in O(1) by bumping a version instead of refilling every entry.
+// Each distance sits next to its stamp, so a lookup touches one cache line.
+class StampedDistances
+{
+   public:
+    StampedDistances() : version_(0) {}
+
+    void reset(size_t vertices)
+    {
+        if (slots_.size() < vertices) {
+            slots_.resize(vertices, {0, 0});
+        }
+        if (++version_ == 0) {
+            for (Slot& slot : slots_) {
+                slot.stamp = 0;
+            }
+            version_ = 1;
+        }
+    }
+
+    Distance get(int v) const
+    {
+        return slots_[v].stamp == version_ ? slots_[v].dist : INF;
+    }
+
+    void set(int v, Distance d)
+    {
+        slots_[v] = {d, version_};
+    }
+
+   private:
+    struct Slot {
+        Distance dist;
+        uint32_t stamp;
+    };
+
+    vector<Slot> slots_;
+    uint32_t     version_;
+};
+
+// Read-only memory map of a whole file
+class MappedFile
+{
+   public:
+    explicit MappedFile(const string& path) : data_(nullptr), size_(0)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("Failed to open " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            close(fd);
+            throw runtime_error("Failed to stat " + path);
+        }
+        size_ = st.st_size;
+        if (size_ > 0) {
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                close(fd);
+                throw runtime_error("Failed to map " + path);
+            }
+            madvise(data, size_, MADV_RANDOM); // Queries touch a few scattered pages
+            data_ = static_cast<const char*>(data);
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (data_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+   private:
+    const char* data_;
+    size_t      size_;
+};
+
+// One worker's reusable state for batched searches. A worker hands the same object to the
+// callback for each of its sources; the results stay valid until the callback returns.
+class SourceSearch
+{
+   public:
+    SourceSearch() : source_(-1) {}
+
+    int source() const
+    {
+        return source_;
+    }
+
+    Distance distance(int v) const
+    {
+        return dist_.get(v);
+    }
+
+    // Reachable vertices in order of distance, so sparse results need no scan over every vertex
+    const vector<int>& reached() const
+    {
+        return reached_;
+    }
+
+   private:
+    friend class Graph;
+
+    int              source_;
+    StampedDistances dist_;
+    RadixHeap        heap_;
+    vector<int>      reached_;
+};
+
+/*
+Undirected weighted graph. Edges are collected as a list and compiled into compressed sparse row
+form: the arcs of vertex u are arcs_[offsets_[u] .. offsets_[u + 1]), each a (target, weight)
+pair, so a relaxation scan is one contiguous read. The CSR arrays are rebuilt on the next query
+after any addEdge(); call build() up front before sharing a Graph between threads.
+
+setWeight() and removeEdge() patch the two arcs of an edge in place, keeping the CSR arrays
+built. A removed edge's arcs become self loops, which no shortest path search can use, and are
+dropped at the next rebuild. Edge ids (the order of addEdge calls) stay stable throughout.
+*/
 class Graph
 {
    public:
-    Graph(int vertices);
-    void addEdge(int u, int v, int weight);
-    void dijkstra(int start);
+    struct Edge {
+        int      u;
+        int      v;
+        uint32_t weight;
+    };
+
+    struct Arc {
+        int      to;
+        uint32_t weight;
+    };
+
+    Graph(int vertices);
+    Graph(int vertices, const vector<Edge>& edges);
+    size_t addEdge(int u, int v, int weight); // Returns the edge id
+    void   setWeight(size_t edge, int weight);
+    void   removeEdge(size_t edge);
+    void   build();
+
+    ShortestPaths dijkstra(int start, HeapKind heap = HeapKind::DAry);
+    // Parallel delta-stepping; threads 0 uses every core and delta 0 uses suggestedDelta()
+    ShortestPaths deltaStepping(int start, size_t threads = 0, Distance delta = 0);
+    Distance      suggestedDelta();
+
+    // Searches from every source on `threads` workers (0 uses every core). visit(i, search) runs
+    // on the worker that searched from sources[i], concurrently with other calls to visit. The
+    // first exception it throws stops the batch and is rethrown here.
+    void forEachSource(const vector<int>& sources,
+                       const function<void(size_t, const SourceSearch&)>& visit,
+                       size_t                                             threads = 0);
+    // Row i holds the distances from sources[i] to each of targets, row-major
+    vector<Distance> distanceMatrix(const vector<int>& sources, const vector<int>& targets,
+                                    size_t threads = 0);
+
+    int    vertexCount() const;
+    size_t edgeCount() const;   // Not counting removed edges
+    size_t memoryBytes() const; // CSR arrays only
+
+   private:
+    friend class ContractionHierarchy;
+    friend class IncrementalShortestPaths;
+
+    int          vertices;
+    vector<Edge> edges;
+    vector<char> removed;
+    size_t       removedCount;
+    bool         built;
+
+    vector<uint32_t> offsets_;
+    vector<Arc>      arcs_;
+    vector<uint32_t> arcPos_; // Arcs of edge e sit at arcPos_[2e] (from u) and arcPos_[2e + 1]
+    uint32_t         maxWeight_;
+
+    const Edge& liveEdge(size_t edge) const;
+
+    template <typename Heap>
+    void runDijkstra(int start, Heap& heap, ShortestPaths& result) const;
+    void runSourceSearch(int start, SourceSearch& search, const vector<char>* targets,
+                         size_t targetCount) const;
+    void runBatch(const vector<int>&                                 sources,
+                  const function<void(size_t, const SourceSearch&)>& visit, size_t threads,
+                  const vector<char>* targets, size_t targetCount);
+};
+
+Graph::Graph(int vertices) : vertices(vertices), removedCount(0), built(false), maxWeight_(0) {}
+
+Graph::Graph(int vertices, const vector<Edge>& edges)
+    : vertices(vertices), removedCount(0), built(false), maxWeight_(0)
+{
+    this->edges.reserve(edges.size());
+    removed.reserve(edges.size());
+    for (const Edge& edge : edges) {
+        addEdge(edge.u, edge.v, edge.weight);
+    }
+}
+
+size_t Graph::addEdge(int u, int v, int weight)
+{
+    if (u < 0 || u >= vertices || v < 0 || v >= vertices) {
+        throw out_of_range("Edge endpoint out of range");
+    }
+    if (weight < 0) {
+        throw invalid_argument("Dijkstra needs non-negative weights");
+    }
+    edges.push_back({u, v, uint32_t(weight)});
+    removed.push_back(0);
+    built = false;
+    return edges.size() - 1;
+}
+
+const Graph::Edge& Graph::liveEdge(size_t edge) const
+{
+    if (edge >= edges.size()) {
+        throw out_of_range("Edge id out of range");
+    }
+    if (removed[edge]) {
+        throw invalid_argument("Edge was removed");
+    }
+    return edges[edge];
+}
+
+void Graph::setWeight(size_t edge, int weight)
+{
+    liveEdge(edge);
+    if (weight < 0) {
+        throw invalid_argument("Dijkstra needs non-negative weights");
+    }
+    edges[edge].weight = weight;
+    if (built) {
+        arcs_[arcPos_[2 * edge]].weight     = weight;
+        arcs_[arcPos_[2 * edge + 1]].weight = weight;
+        maxWeight_                          = max(maxWeight_, uint32_t(weight));
+    }
+}
+
+void Graph::removeEdge(size_t edge)
+{
+    const Edge& e = liveEdge(edge);
+    removed[edge] = 1;
+    removedCount++;
+    if (built) {
+        arcs_[arcPos_[2 * edge]].to     = e.u;
+        arcs_[arcPos_[2 * edge + 1]].to = e.v;
+    }
+}
+
+// Counting sort of both directions of every edge into CSR
+void Graph::build()
+{
+    if (built) {
+        return;
+    }
+    offsets_.assign(vertices + 1, 0);
+    for (size_t e = 0; e < edges.size(); ++e) {
+        if (!removed[e]) {
+            offsets_[edges[e].u + 1]++;
+            offsets_[edges[e].v + 1]++; // For undirected graph
+        }
+    }
+    for (int i = 0; i < vertices; ++i) {
+        offsets_[i + 1] += offsets_[i];
+    }
+    arcs_.resize(offsets_[vertices]);
+    vector<uint32_t> fill(offsets_.begin(), offsets_.end() - 1);
+    arcPos_.assign(2 * edges.size(), 0);
+    maxWeight_ = 0;
+    for (size_t e = 0; e < edges.size(); ++e) {
+        if (removed[e]) {
+            continue;
+        }
+        const Edge& edge   = edges[e];
+        arcPos_[2 * e]     = fill[edge.u];
+        arcPos_[2 * e + 1] = fill[edge.v];
+        arcs_[fill[edge.u]++] = {edge.v, edge.weight};
+        arcs_[fill[edge.v]++] = {edge.u, edge.weight};
+        maxWeight_            = max(maxWeight_, edge.weight);
+    }
+    built = true;
+}
+
+int Graph::vertexCount() const
+{
+    return vertices;
+}
+
+size_t Graph::edgeCount() const
+{
+    return edges.size() - removedCount;
+}
+
+size_t Graph::memoryBytes() const
+{
+    return (offsets_.capacity() + arcPos_.capacity()) * sizeof(uint32_t) +
+           arcs_.capacity() * sizeof(Arc);
+}
+
+ShortestPaths Graph::dijkstra(int start, HeapKind heap)
+{
+    build();
+    ShortestPaths result;
+    result.dist.assign(vertices, INF);
+    result.parent.assign(vertices, -1);
+    if (heap == HeapKind::Binary) {
+        BinaryHeap queue;
+        runDijkstra(start, queue, result);
+    } else if (heap == HeapKind::Radix) {
+        RadixHeap queue;
+        runDijkstra(start, queue, result);
+    } else {
+        DaryHeap queue(vertices);
+        runDijkstra(start, queue, result);
+    }
+    return result;
+}
+
+template <typename Heap>
+void Graph::runDijkstra(int start, Heap& pq, ShortestPaths& result) const
+{
+    vector<Distance>& dist = result.dist;
+    dist[start]            = 0;
+    pq.push(0, start);
+
+    while (!pq.empty()) {
+        auto [d, u] = pq.pop();
+        if (d > dist[u]) {
+            continue; // Stale: u was settled through a shorter path already
+        }
+
+        for (uint32_t i = offsets_[u]; i < offsets_[u + 1]; ++i) {
+            const Arc& arc = arcs_[i];
+            Distance   nd  = d + arc.weight;
+            if (nd < dist[arc.to]) {
+                dist[arc.to]          = nd;
+                result.parent[arc.to] = u;
+                pq.push(nd, arc.to);
+            }
+        }
+    }
+}
+
+// Meyer and Sanders set delta near maxWeight / degree. The 90th percentile of a weight sample
+// stands in for the maximum so that a few outlying weights do not make every bucket coarse.
+Distance Graph::suggestedDelta()
+{
+    build();
+    if (arcs_.empty()) {
+        return 1;
+    }
+    const size_t     samples = min<size_t>(arcs_.size(), 4096);
+    vector<uint32_t> weights(samples);
+    for (size_t i = 0; i < samples; ++i) {
+        weights[i] = arcs_[i * arcs_.size() / samples].weight;
+    }
+    auto high = weights.begin() + samples * 9 / 10;
+    nth_element(weights.begin(), high, weights.end());
+    Distance degree = max<Distance>(1, arcs_.size() / vertices);
+    return max<Distance>(1, *high / degree);
+}
+
+/*
+Delta-stepping (Meyer and Sanders). Tentative distances are grouped into buckets of width delta.
+All vertices of the lowest non-empty bucket are relaxed together, so each bucket is a parallel
+phase instead of one heap pop per vertex.
+
+Arcs no heavier than delta are light. Relaxing a light arc can only land in the current or the
+next bucket, so light arcs are relaxed repeatedly until the current bucket stays empty. Heavy
+arcs are relaxed once per bucket, from every vertex settled in it, after its distances are final.
+
+Every thread owns its buckets and pushes only into them. Each phase, a thread turns its share of
+the current bucket into a frontier, and idle threads take chunks from other threads' frontiers.
+The buckets are cyclic, because pending distances never lie more than maxWeight past the
+current bucket. The cycle is capped at a few thousand buckets so that an outlying weight cannot
+make it huge; a distance beyond the cycle waits in its thread's overflow list, which is
+redistributed once the current bucket comes within reach of it. Distances are updated with
+atomics and the parent is set under a striped lock, so the parent always belongs to the last
+improvement of the distance.
+*/
+ShortestPaths Graph::deltaStepping(int start, size_t threads, Distance delta)
+{
+    build();
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+    if (delta <= 0) {
+        delta = suggestedDelta();
+    }
+    const size_t slots = min<size_t>(maxWeight_ / delta + 2, 4096);
+    const size_t chunk = 256;
+
+    ShortestPaths result;
+    result.dist.assign(vertices, INF);
+    result.parent.assign(vertices, -1);
+    vector<Distance>& dist   = result.dist;
+    vector<int>&      parent = result.parent;
+    dist[start]              = 0;
+
+    struct Worker {
+        vector<vector<int>> buckets;
+        vector<int>         frontier;
+        vector<int>         settled;  // Vertices processed in the current bucket
+        vector<int>         overflow; // Too far ahead for the cycle, none below overflowMin
+        Distance            overflowMin = INF;
+        atomic<size_t>      cursor{0};
+    };
+    vector<Worker> workers(threads);
+    for (Worker& worker : workers) {
+        worker.buckets.resize(slots);
+    }
+    workers[0].buckets[0].push_back(start);
+
+    auto             locks = make_unique<StripedLocks>();
+    atomic<size_t>   pending{0};
+    atomic<Distance> nextBucket{INF};
+    size_t           frontierSize = 0;
+    Distance         foundBucket  = INF;
+    // Runs once per barrier, after every thread has arrived
+    auto collect = [&]() noexcept {
+        frontierSize = pending.exchange(0);
+        foundBucket  = nextBucket.exchange(INF);
+        for (Worker& worker : workers) {
+            worker.cursor.store(0, memory_order_relaxed);
+        }
+    };
+    barrier sync(threads, collect);
+
+    // Queue v in its bucket, or in the overflow list if that lies past the cycle
+    auto push = [&](Worker& self, int v, Distance bucket, Distance current) {
+        if (bucket < current + Distance(slots)) {
+            self.buckets[bucket % slots].push_back(v);
+        } else {
+            self.overflow.push_back(v);
+            self.overflowMin = min(self.overflowMin, bucket);
+        }
+    };
+
+    // Move the overflow entries the cycle now reaches into buckets. Entries whose vertex has
+    // since been settled through a shorter path are dropped.
+    auto redistribute = [&](Worker& self, Distance current) {
+        vector<int> waiting;
+        waiting.swap(self.overflow);
+        self.overflowMin = INF;
+        for (int v : waiting) {
+            Distance bucket = atomic_ref<Distance>(dist[v]).load(memory_order_relaxed) / delta;
+            if (bucket >= current) {
+                push(self, v, bucket, current);
+            }
+        }
+    };
+
+    auto relax = [&](Worker& self, int u, Distance d, bool heavy, Distance current) {
+        for (uint32_t i = offsets_[u]; i < offsets_[u + 1]; ++i) {
+            const Arc& arc = arcs_[i];
+            if ((arc.weight > delta) != heavy) {
+                continue;
+            }
+            Distance             nd = d + arc.weight;
+            atomic_ref<Distance> target(dist[arc.to]);
+            if (nd >= target.load(memory_order_relaxed)) {
+                continue;
+            }
+            locks->lock(arc.to);
+            bool improved = nd < target.load(memory_order_relaxed);
+            if (improved) {
+                target.store(nd, memory_order_relaxed);
+                parent[arc.to] = u;
+            }
+            locks->unlock(arc.to);
+            if (improved) {
+                push(self, arc.to, nd / delta, current);
+            }
+        }
+    };
+
+    parallelFor(threads, [&](size_t self) {
+        Worker&  me      = workers[self];
+        Distance current = 0;
+        while (true) {
+            while (true) {
+                vector<int>& bucket = me.buckets[current % slots];
+                me.frontier.clear();
+                me.frontier.swap(bucket);
+                pending.fetch_add(me.frontier.size(), memory_order_relaxed);
+                sync.arrive_and_wait();
+                if (frontierSize == 0) {
+                    break;
+                }
+                // Own frontier first, then help with the others
+                for (size_t k = 0; k < threads; ++k) {
+                    Worker&      owner = workers[(self + k) % threads];
+                    const size_t size  = owner.frontier.size();
+                    size_t       begin;
+                    while ((begin = owner.cursor.fetch_add(chunk, memory_order_relaxed)) < size) {
+                        for (size_t i = begin; i < min(begin + chunk, size); ++i) {
+                            int      v = owner.frontier[i];
+                            Distance d = atomic_ref<Distance>(dist[v]).load(memory_order_relaxed);
+                            if (d / delta != current) {
+                                continue; // Stale: v has moved to a lower bucket since
+                            }
+                            me.settled.push_back(v);
+                            relax(me, v, d, false, current);
+                        }
+                    }
+                }
+                sync.arrive_and_wait();
+            }
+
+            for (int v : me.settled) {
+                Distance d = atomic_ref<Distance>(dist[v]).load(memory_order_relaxed);
+                relax(me, v, d, true, current);
+            }
+            me.settled.clear();
+
+            Distance next = INF;
+            for (size_t k = 1; k < slots && next == INF; ++k) {
+                if (!me.buckets[(current + k) % slots].empty()) {
+                    next = current + k;
+                }
+            }
+            if (next == INF) {
+                next = me.overflowMin; // Everything in the cycle lies below the overflow
+            }
+            Distance seen = nextBucket.load(memory_order_relaxed);
+            while (next < seen && !nextBucket.compare_exchange_weak(seen, next)) {
+            }
+            sync.arrive_and_wait();
+            if (foundBucket == INF) {
+                break;
+            }
+            current = foundBucket;
+            if (me.overflowMin < current + Distance(slots)) {
+                redistribute(me, current);
+            }
+        }
+    });
+    return result;
+}
+
+/*
+Contraction hierarchy for point-to-point distances on a static Graph.
+
+Preprocessing contracts the vertices one at a time. Contracting v removes it and links each
+pair of its remaining neighbours u, w with a shortcut of length d(u, v) + d(v, w), unless a
+witness search finds a path that avoids v and is no longer. The next vertex comes from a lazily
+updated heap. Its key is twice the edge difference (shortcuts added minus arcs removed), plus
+the number of neighbours already contracted, plus the depth of the hierarchy below the vertex.
+The last two terms spread contraction evenly over the graph, which keeps query searches small.
+Witness searches are capped in settled vertices: tightly when only re-estimating a neighbour's
+key, and more loosely when contracting. The cap can add unneeded shortcuts but never loses a
+distance.
+
+Only the upward graph is kept: for each vertex, the original and shortcut arcs to vertices
+contracted after it. Every shortest path has an equally short version that first climbs and then
+descends in contraction order. A query therefore runs Dijkstra upwards from both ends and
+returns the best meeting vertex. Each side stops once its queue minimum reaches that best, and
+skips ("stalls") vertices that a higher neighbour already reaches more cheaply.
+
+The index is one flat block (header, CSR offsets, arcs) with the same layout in memory and on
+disk, so load() maps the file and answers queries straight from the page cache.
+*/
+class ContractionHierarchy
+{
+   public:
+    explicit ContractionHierarchy(Graph& graph);
+    static ContractionHierarchy load(const string& path);
+    void                        save(const string& path) const;
+
+    // Safe to call from many threads at once; each thread keeps its own search scratch
+    Distance distance(int source, int target) const;
+
+    int    vertexCount() const;
+    size_t arcCount() const;
+    size_t shortcutCount() const;
+    size_t indexBytes() const;
+
+   private:
+    struct Header {
+        uint64_t magic;
+        uint64_t vertices;
+        uint64_t arcs;
+        uint64_t shortcuts;
+    };
+
+    struct UpArc {
+        Distance weight; // Shortcuts add up weights, so 64 bits here
+        int64_t  to;
+    };
+
+    static const uint64_t magic             = 0x3148434850415247; // "GRAPHCH1"
+    static const size_t   maxWitnessSettled = 500; // When contracting
+    static const size_t   estimateSettled   = 30;  // When only estimating a priority
+
+    vector<uint64_t>       storage_; // The block, after a build
+    unique_ptr<MappedFile> mapped_;  // The block, after a load
+    const Header*          header_;
+    const uint64_t*        offsets_;
+    const UpArc*           arcs_;
+
+    explicit ContractionHierarchy(unique_ptr<MappedFile> mapped);
+    void attach(const char* block, size_t bytes);
+};
+
+ContractionHierarchy::ContractionHierarchy(Graph& graph)
+{
+    graph.build();
+    const int n = graph.vertices;
+
+    // Working adjacency, shrinking logically as vertices are contracted
+    vector<vector<pair<int, Distance>>> adj(n);
+    auto link = [&](int u, int w, Distance d) {
+        for (auto& [to, weight] : adj[u]) {
+            if (to == w) {
+                weight = min(weight, d);
+                return false;
+            }
+        }
+        adj[u].push_back({w, d});
+        return true;
+    };
+    for (int u = 0; u < n; ++u) {
+        for (uint32_t i = graph.offsets_[u]; i < graph.offsets_[u + 1]; ++i) {
+            if (graph.arcs_[i].to != u) {
+                link(u, graph.arcs_[i].to, graph.arcs_[i].weight);
+            }
+        }
+    }
+
+    vector<char>                        contracted(n, 0);
+    vector<int>                         deleted(n, 0); // Neighbours contracted so far
+    vector<int>                         level(n, 0);   // Longest contracted chain below
+    vector<vector<pair<int, Distance>>> upward(n);
+    StampedDistances                    witness;
+    vector<pair<Distance, int>>         witnessHeap;
+    vector<pair<int, Distance>>         neighbours;
+    vector<tuple<int, int, Distance>>   shortcuts;
+
+    // Dijkstra from source avoiding skip and contracted vertices. Stops at limit, at the settle
+    // cap, or once every other vertex marked as a target has been settled.
+    vector<char> isTarget(n, 0);
+    auto witnessSearch = [&](int source, int skip, Distance limit, size_t targets, size_t cap) {
+        witness.reset(n);
+        witness.set(source, 0);
+        witnessHeap.assign(1, {0, source});
+        for (size_t settled = 0; !witnessHeap.empty() && settled < cap;) {
+            pop_heap(witnessHeap.begin(), witnessHeap.end(), greater<>());
+            auto [d, u] = witnessHeap.back();
+            witnessHeap.pop_back();
+            if (d > witness.get(u)) {
+                continue;
+            }
+            if (d > limit) {
+                break;
+            }
+            settled++;
+            if (isTarget[u] && u != source && --targets == 0) {
+                break;
+            }
+            for (auto [w, weight] : adj[u]) {
+                Distance nd = d + weight;
+                if (contracted[w] || w == skip || nd > limit || nd >= witness.get(w)) {
+                    continue;
+                }
+                witness.set(w, nd);
+                witnessHeap.push_back({nd, w});
+                push_heap(witnessHeap.begin(), witnessHeap.end(), greater<>());
+            }
+        }
+    };
+
+    // Fills neighbours and the shortcuts that contracting v would need; returns its priority
+    auto simulate = [&](int v, size_t cap) {
+        neighbours.clear();
+        Distance farthest = 0;
+        for (auto [w, weight] : adj[v]) {
+            if (!contracted[w]) {
+                neighbours.push_back({w, weight});
+                farthest = max(farthest, weight);
+            }
+        }
+        shortcuts.clear();
+        for (auto [w, weight] : neighbours) {
+            isTarget[w] = 1;
+        }
+        for (size_t i = 0; i + 1 < neighbours.size(); ++i) {
+            auto [u, du] = neighbours[i];
+            witnessSearch(u, v, du + farthest, neighbours.size() - 1, cap);
+            for (size_t j = i + 1; j < neighbours.size(); ++j) {
+                auto [w, dw] = neighbours[j];
+                if (witness.get(w) > du + dw) {
+                    shortcuts.push_back({u, w, du + dw});
+                }
+            }
+        }
+        for (auto [w, weight] : neighbours) {
+            isTarget[w] = 0;
+        }
+        return 2 * (int(shortcuts.size()) - int(neighbours.size())) + deleted[v] + level[v];
+    };
+
+    vector<int> priority(n);
+    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> order;
+    for (int v = 0; v < n; ++v) {
+        priority[v] = simulate(v, estimateSettled);
+        order.push({priority[v], v});
+    }
+    uint64_t added = 0;
+    while (!order.empty()) {
+        auto [p, v] = order.top();
+        order.pop();
+        if (contracted[v] || p != priority[v]) {
+            continue; // Stale entry
+        }
+        // Neighbour updates keep most priorities current; re-check the winner before contracting
+        priority[v] = simulate(v, maxWitnessSettled);
+        if (!order.empty() && priority[v] > order.top().first) {
+            order.push({priority[v], v});
+            continue;
+        }
+        for (auto [u, w, d] : shortcuts) {
+            added += link(u, w, d);
+            link(w, u, d);
+        }
+        // v keeps its arcs to the remaining vertices, which all rank above it, and leaves adj
+        contracted[v] = 1;
+        upward[v]     = neighbours;
+        vector<pair<int, Distance>>().swap(adj[v]);
+        for (auto [w, weight] : upward[v]) {
+            auto& arcs = adj[w];
+            arcs.erase(find_if(arcs.begin(), arcs.end(), [v](auto& a) { return a.first == v; }));
+            deleted[w]++;
+            level[w] = max(level[w], level[v] + 1);
+        }
+        for (auto [w, weight] : upward[v]) {
+            priority[w] = simulate(w, estimateSettled);
+            order.push({priority[w], w});
+        }
+    }
+
+    // Lay out the block: header, offsets, then each vertex's upward arcs
+    uint64_t arcs = 0;
+    for (int v = 0; v < n; ++v) {
+        arcs += upward[v].size();
+    }
+    const size_t words = sizeof(Header) / 8 + (n + 1) + arcs * sizeof(UpArc) / 8;
+    storage_.assign(words, 0);
+    Header*   header  = reinterpret_cast<Header*>(storage_.data());
+    *header           = {magic, uint64_t(n), arcs, added};
+    uint64_t* offsets = storage_.data() + sizeof(Header) / 8;
+    UpArc*    up      = reinterpret_cast<UpArc*>(offsets + n + 1);
+    for (int v = 0; v < n; ++v) {
+        offsets[v + 1] = offsets[v];
+        for (auto [w, weight] : upward[v]) {
+            up[offsets[v + 1]++] = {weight, w};
+        }
+    }
+    attach(reinterpret_cast<const char*>(storage_.data()), words * 8);
+}
+
+ContractionHierarchy::ContractionHierarchy(unique_ptr<MappedFile> mapped) : mapped_(move(mapped))
+{
+    attach(mapped_->data(), mapped_->size());
+}
+
+ContractionHierarchy ContractionHierarchy::load(const string& path)
+{
+    return ContractionHierarchy(make_unique<MappedFile>(path));
+}
+
+void ContractionHierarchy::save(const string& path) const
+{
+    ofstream out(path, ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char*>(header_), indexBytes());
+    if (!out) {
+        throw runtime_error("Failed to write " + path);
+    }
+}
+
+// Checks that the block is a complete index and points the accessors into it
+void ContractionHierarchy::attach(const char* block, size_t bytes)
+{
+    header_ = reinterpret_cast<const Header*>(block);
+    if (bytes < sizeof(Header) || header_->magic != magic) {
+        throw runtime_error("Not a contraction hierarchy index");
+    }
+    offsets_ = reinterpret_cast<const uint64_t*>(block + sizeof(Header));
+    arcs_    = reinterpret_cast<const UpArc*>(offsets_ + header_->vertices + 1);
+    if (bytes != indexBytes() || offsets_[header_->vertices] != header_->arcs) {
+        throw runtime_error("Truncated contraction hierarchy index");
+    }
+}
+
+Distance ContractionHierarchy::distance(int source, int target) const
+{
+    if (source < 0 || source >= vertexCount() || target < 0 || target >= vertexCount()) {
+        throw out_of_range("Query vertex out of range");
+    }
+    struct Scratch {
+        StampedDistances            dist[2];
+        vector<pair<Distance, int>> heap[2];
+    };
+    thread_local Scratch scratch;
+
+    const int ends[2] = {source, target};
+    for (int side = 0; side < 2; ++side) {
+        scratch.dist[side].reset(vertexCount());
+        scratch.dist[side].set(ends[side], 0);
+        scratch.heap[side].assign(1, {0, ends[side]});
+    }
+    Distance best = source == target ? 0 : INF;
+    while (true) {
+        // Advance the side with the smaller queue minimum, while it can still beat best
+        int side = -1;
+        for (int s = 0; s < 2; ++s) {
+            const auto& heap = scratch.heap[s];
+            if (!heap.empty() && heap[0].first < best &&
+                (side < 0 || heap[0].first < scratch.heap[side][0].first)) {
+                side = s;
+            }
+        }
+        if (side < 0) {
+            return best;
+        }
+        auto&             heap = scratch.heap[side];
+        StampedDistances& dist = scratch.dist[side];
+        pop_heap(heap.begin(), heap.end(), greater<>());
+        auto [d, u] = heap.back();
+        heap.pop_back();
+        if (d > dist.get(u)) {
+            continue;
+        }
+        Distance other = scratch.dist[1 - side].get(u);
+        if (other != INF) {
+            best = min(best, d + other);
+        }
+        // Stall on demand: a higher neighbour already offers a shorter way down to u, so d is
+        // not u's distance and no shortest path climbs on through u
+        bool stalled = false;
+        for (uint64_t i = offsets_[u]; i < offsets_[u + 1] && !stalled; ++i) {
+            Distance above = dist.get(int(arcs_[i].to));
+            stalled        = above != INF && above + arcs_[i].weight < d;
+        }
+        if (stalled) {
+            continue;
+        }
+        for (uint64_t i = offsets_[u]; i < offsets_[u + 1]; ++i) {
+            Distance nd = d + arcs_[i].weight;
+            int      to = int(arcs_[i].to);
+            if (nd < dist.get(to)) {
+                dist.set(to, nd);
+                heap.push_back({nd, to});
+                push_heap(heap.begin(), heap.end(), greater<>());
+            }
+        }
+    }
+}
+
+int ContractionHierarchy::vertexCount() const
+{
+    return int(header_->vertices);
+}
+
+size_t ContractionHierarchy::arcCount() const
+{
+    return header_->arcs;
+}
+
+size_t ContractionHierarchy::shortcutCount() const
+{
+    return header_->shortcuts;
+}
+
+size_t ContractionHierarchy::indexBytes() const
+{
+    return sizeof(Header) + (header_->vertices + 1) * sizeof(uint64_t) +
+           header_->arcs * sizeof(UpArc);
+}
+
+// Dijkstra into reusable scratch: the version stamp resets the distances in O(1). With targets
+// marked, the search stops once targetCount of them are settled; other distances may then be
+// tentative.
+void Graph::runSourceSearch(int start, SourceSearch& search, const vector<char>* targets,
+                            size_t targetCount) const
+{
+    search.source_ = start;
+    search.dist_.reset(vertices);
+    search.heap_.clear();
+    search.reached_.clear();
+    search.dist_.set(start, 0);
+    search.heap_.push(0, start);
+
+    while (!search.heap_.empty()) {
+        auto [d, u] = search.heap_.pop();
+        if (d > search.dist_.get(u)) {
+            continue;
+        }
+        search.reached_.push_back(u);
+        if (targets && (*targets)[u] && --targetCount == 0) {
+            return;
+        }
+        for (uint32_t i = offsets_[u]; i < offsets_[u + 1]; ++i) {
+            Distance nd = d + arcs_[i].weight;
+            if (nd < search.dist_.get(arcs_[i].to)) {
+                search.dist_.set(arcs_[i].to, nd);
+                search.heap_.push(nd, arcs_[i].to);
+            }
+        }
+    }
+}
+
+void Graph::forEachSource(const vector<int>&                                 sources,
+                          const function<void(size_t, const SourceSearch&)>& visit,
+                          size_t                                             threads)
+{
+    runBatch(sources, visit, threads, nullptr, 0);
+}
+
+void Graph::runBatch(const vector<int>&                                 sources,
+                     const function<void(size_t, const SourceSearch&)>& visit, size_t threads,
+                     const vector<char>* targets, size_t targetCount)
+{
+    for (int source : sources) {
+        if (source < 0 || source >= vertices) {
+            throw out_of_range("Source vertex out of range");
+        }
+    }
+    build();
+    if (threads == 0) {
+        threads = max(1u, thread::hardware_concurrency());
+    }
+    threads = max<size_t>(1, min(threads, sources.size()));
+
+    // Workers claim sources from a shared counter; searches cost about the same, so no stealing
+    atomic<size_t> next(0);
+    exception_ptr  failure;
+    mutex          failureLock;
+    atomic<bool>   failed(false);
+    parallelFor(threads, [&](size_t) {
+        SourceSearch search;
+        for (size_t i; !failed && (i = next.fetch_add(1)) < sources.size();) {
+            try {
+                runSourceSearch(sources[i], search, targets, targetCount);
+                visit(i, search);
+            } catch (...) {
+                lock_guard<mutex> guard(failureLock);
+                if (!failure) {
+                    failure = current_exception();
+                }
+                failed = true;
+            }
+        }
+    });
+    if (failure) {
+        rethrow_exception(failure);
+    }
+}
+
+vector<Distance> Graph::distanceMatrix(const vector<int>& sources, const vector<int>& targets,
+                                       size_t threads)
+{
+    vector<char> isTarget(vertices, 0);
+    size_t       distinct = 0;
+    for (int target : targets) {
+        if (target < 0 || target >= vertices) {
+            throw out_of_range("Target vertex out of range");
+        }
+        distinct += !isTarget[target];
+        isTarget[target] = 1;
+    }
+    vector<Distance> matrix(sources.size() * targets.size());
+    runBatch(
+        sources,
+        [&](size_t i, const SourceSearch& search) {
+            Distance* row = matrix.data() + i * targets.size();
+            for (size_t j = 0; j < targets.size(); ++j) {
+                row[j] = search.distance(targets[j]);
+            }
+        },
+        threads, &isTarget, distinct);
+    return matrix;
+}
+
+/*
+Shortest paths from one source, kept current while edge weights change, in the style of
+Ramalingam and Reps. A batch of updates is repaired in one pass:
+  1. A heavier or removed tree edge u - v, with parent[v] == u, invalidates the subtree under v.
+     Children are found by scanning each vertex's arcs for parent[child] == vertex, so no child
+     lists are kept.
+  2. Every vertex of those subtrees is relabelled from its best neighbour outside them.
+  3. Each lighter edge offers its endpoints a shorter label.
+  4. Dijkstra, seeded with every relabelled vertex, runs until nothing improves.
+Labels outside the invalidated subtrees are lengths of paths that still exist, so each label
+stays an upper bound. Step 4 stops with every edge satisfied, so the labels are exact. The work
+is proportional to the region whose distances change, not to the graph.
+
+Changes to the graph through other means (addEdge, or Graph::setWeight directly) are not seen;
+build a new tracker after them. apply() checks the whole batch before changing anything.
+*/
+class IncrementalShortestPaths
+{
+   public:
+    struct Update {
+        size_t edge;
+        int    weight;
+        bool   remove = false;
+    };
+
+    IncrementalShortestPaths(Graph& graph, int source);
+    void                 apply(const vector<Update>& updates);
+    const ShortestPaths& paths() const;
+    size_t               lastRepairSize() const; // Vertices re-settled by the last apply()
 
    private:
-    int                            vertices;
-    vector<vector<pair<int, int>>> adjList;
+    Graph&        graph_;
+    ShortestPaths paths_;
+    vector<char>  invalid_;  // Scratch, all zero between calls
+    vector<int>   subtree_;  // Scratch
+    RadixHeap     heap_;     // Scratch
+    size_t        repaired_;
 };
 
-Graph::Graph(int vertices) : vertices(vertices)
+IncrementalShortestPaths::IncrementalShortestPaths(Graph& graph, int source)
+    : graph_(graph), paths_(graph.dijkstra(source, HeapKind::Radix)),
+      invalid_(graph.vertexCount(), 0), repaired_(0)
 {
-    adjList.resize(vertices);
 }
 
-void Graph::addEdge(int u, int v, int weight)
+void IncrementalShortestPaths::apply(const vector<Update>& updates)
 {
-    adjList[u].emplace_back(v, weight);
-    adjList[v].emplace_back(u, weight); // For undirected graph
+    vector<Distance>& dist   = paths_.dist;
+    vector<int>&      parent = paths_.parent;
+    vector<size_t>    lighter;
+    subtree_.clear();
+    auto invalidate = [&](int v) {
+        if (!invalid_[v]) {
+            invalid_[v] = 1;
+            subtree_.push_back(v);
+        }
+    };
+
+    // Sorted by edge, then by position: a removal followed by the same edge is an error
+    vector<pair<size_t, size_t>> order;
+    for (size_t i = 0; i < updates.size(); ++i) {
+        graph_.liveEdge(updates[i].edge);
+        if (!updates[i].remove && updates[i].weight < 0) {
+            throw invalid_argument("Dijkstra needs non-negative weights");
+        }
+        order.push_back({updates[i].edge, i});
+    }
+    sort(order.begin(), order.end());
+    for (size_t k = 1; k < order.size(); ++k) {
+        if (order[k].first == order[k - 1].first && updates[order[k - 1].second].remove) {
+            throw invalid_argument("Edge was removed");
+        }
+    }
+
+    for (const Update& update : updates) {
+        Graph::Edge edge = graph_.edges[update.edge];
+        if (update.remove || uint32_t(update.weight) > edge.weight) {
+            if (parent[edge.v] == edge.u) {
+                invalidate(edge.v);
+            } else if (parent[edge.u] == edge.v) {
+                invalidate(edge.u);
+            }
+        }
+        if (update.remove) {
+            graph_.removeEdge(update.edge);
+        } else {
+            graph_.setWeight(update.edge, update.weight);
+            if (uint32_t(update.weight) < edge.weight) {
+                lighter.push_back(update.edge);
+            }
+        }
+    }
+
+    const vector<uint32_t>&   offsets = graph_.offsets_;
+    const vector<Graph::Arc>& arcs    = graph_.arcs_;
+    for (size_t i = 0; i < subtree_.size(); ++i) {
+        int u = subtree_[i];
+        for (uint32_t a = offsets[u]; a < offsets[u + 1]; ++a) {
+            if (parent[arcs[a].to] == u) {
+                invalidate(arcs[a].to);
+            }
+        }
+    }
+    for (int v : subtree_) {
+        dist[v]   = INF;
+        parent[v] = -1;
+    }
+
+    heap_.clear();
+    for (int v : subtree_) {
+        for (uint32_t a = offsets[v]; a < offsets[v + 1]; ++a) {
+            int from = arcs[a].to;
+            if (!invalid_[from] && dist[from] != INF && dist[from] + arcs[a].weight < dist[v]) {
+                dist[v]   = dist[from] + arcs[a].weight;
+                parent[v] = from;
+            }
+        }
+        if (dist[v] != INF) {
+            heap_.push(dist[v], v);
+        }
+    }
+    for (size_t id : lighter) {
+        if (graph_.removed[id]) {
+            continue; // Removed later in the same batch
+        }
+        const Graph::Edge& edge = graph_.edges[id];
+        for (int dir = 0; dir < 2; ++dir) {
+            int from = dir ? edge.v : edge.u, to = dir ? edge.u : edge.v;
+            if (dist[from] != INF && dist[from] + edge.weight < dist[to]) {
+                dist[to]   = dist[from] + edge.weight;
+                parent[to] = from;
+                heap_.push(dist[to], to);
+            }
+        }
+    }
+    for (int v : subtree_) {
+        invalid_[v] = 0;
+    }
+
+    repaired_ = 0;
+    while (!heap_.empty()) {
+        auto [d, u] = heap_.pop();
+        if (d > dist[u]) {
+            continue;
+        }
+        repaired_++;
+        for (uint32_t a = offsets[u]; a < offsets[u + 1]; ++a) {
+            Distance nd = d + arcs[a].weight;
+            if (nd < dist[arcs[a].to]) {
+                dist[arcs[a].to]   = nd;
+                parent[arcs[a].to] = u;
+                heap_.push(nd, arcs[a].to);
+            }
+        }
+    }
 }
 
-void Graph::dijkstra(int start)
+const ShortestPaths& IncrementalShortestPaths::paths() const
 {
-    vector<int> dist(vertices, INF);
-    dist[start] = 0;
+    return paths_;
+}
 
-    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> pq;
-    pq.emplace(0, start);
+size_t IncrementalShortestPaths::lastRepairSize() const
+{
+    return repaired_;
+}
 
-    while (!pq.empty()) {
-        int u = pq.top().second;
-        pq.pop();
+void printDistances(const ShortestPaths& paths)
+{
+    cout << "Vertex\tDistance from Source\n";
+    for (size_t i = 0; i < paths.dist.size(); ++i) {
+        cout << i << "\t";
+        if (paths.dist[i] == INF) {
+            cout << "unreachable\n";
+        } else {
+            cout << paths.dist[i] << "\n";
+        }
+    }
+}
 
-        for (const auto& neighbor : adjList[u]) {
-            int v      = neighbor.first;
-            int weight = neighbor.second;
+// Connected random graph: a random spanning tree plus extra random edges
+vector<Graph::Edge> randomEdges(int vertices, size_t edges, uint32_t maxWeight, unsigned seed)
+{
+    mt19937                            rng(seed);
+    uniform_int_distribution<uint32_t> weight(1, maxWeight);
+    vector<Graph::Edge>                result;
+    result.reserve(edges);
+    for (int v = 1; v < vertices && result.size() < edges; ++v) {
+        result.push_back({int(rng() % v), v, weight(rng)});
+    }
+    while (result.size() < edges) {
+        result.push_back({int(rng() % vertices), int(rng() % vertices), weight(rng)});
+    }
+    return result;
+}
 
-            if (dist[u] + weight < dist[v]) {
-                dist[v] = dist[u] + weight;
-                pq.emplace(dist[v], v);
+// Grid with random weights, a stand-in for road networks, which have the hierarchy CH exploits
+vector<Graph::Edge> gridEdges(int side, uint32_t maxWeight, unsigned seed)
+{
+    mt19937                            rng(seed);
+    uniform_int_distribution<uint32_t> weight(1, maxWeight);
+    vector<Graph::Edge>                result;
+    for (int r = 0; r < side; ++r) {
+        for (int c = 0; c < side; ++c) {
+            int v = r * side + c;
+            if (c + 1 < side) {
+                result.push_back({v, v + 1, weight(rng)});
+            }
+            if (r + 1 < side) {
+                result.push_back({v, v + side, weight(rng)});
             }
         }
     }
+    return result;
+}
 
-    cout << "Vertex\tDistance from Source\n";
-    for (int i = 0; i < vertices; ++i) {
-        cout << i << "\t" << dist[i] << "\n";
+// Reference distances by repeated relaxation, for checking on small graphs
+vector<Distance> bellmanFord(int vertices, const vector<Graph::Edge>& edges, int start)
+{
+    vector<Distance> dist(vertices, INF);
+    dist[start] = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (const auto& edge : edges) {
+            for (int dir = 0; dir < 2; ++dir) {
+                int from = dir ? edge.v : edge.u, to = dir ? edge.u : edge.v;
+                if (dist[from] != INF && dist[from] + edge.weight < dist[to]) {
+                    dist[to] = dist[from] + edge.weight;
+                    changed  = true;
+                }
+            }
+        }
     }
+    return dist;
 }
 
 void testDjikstra()
@@ -74,13 +1510,323 @@ void testDjikstra()
 
     int startVertex = 0;
     cout << "Dijkstra's Algorithm starting from vertex " << startVertex << ":\n";
-    g.dijkstra(startVertex);
+    ShortestPaths paths = g.dijkstra(startVertex);
+    printDistances(paths);
+
+    customAssert(paths.dist == vector<Distance>({0, 4, 2, 9, 5}));
+    customAssert(paths.path(3) == vector<int>({0, 2, 4, 3}));
+    customAssert(paths.path(0) == vector<int>({0}));
+}
+
+void testHeapsAgreeWithReference()
+{
+    for (unsigned seed = 1; seed <= 5; ++seed) {
+        auto             edges = randomEdges(300, 1500, seed % 2 ? 10 : 1000000, seed);
+        Graph            g(300, edges);
+        vector<Distance> expected = bellmanFord(300, edges, 7);
+        for (HeapKind heap : {HeapKind::Binary, HeapKind::DAry, HeapKind::Radix}) {
+            ShortestPaths paths = g.dijkstra(7, heap);
+            customAssert(paths.dist == expected);
+            // Parents lead back to the source, getting closer with every (positive) edge
+            for (int v = 0; v < 300; ++v) {
+                customAssert(paths.path(v).front() == 7);
+                customAssert(v == 7 || paths.dist[paths.parent[v]] < paths.dist[v]);
+            }
+        }
+    }
+}
+
+void testUnreachableAndRebuild()
+{
+    Graph g(4);
+    g.addEdge(0, 1, 3);
+    ShortestPaths paths = g.dijkstra(0, HeapKind::Radix);
+    customAssert(paths.dist[2] == INF && paths.parent[2] == -1 && paths.path(2).empty());
+
+    g.addEdge(1, 2, 4); // Invalidates the CSR arrays
+    g.addEdge(2, 3, 0);
+    paths = g.dijkstra(0, HeapKind::Binary);
+    customAssert(paths.dist == vector<Distance>({0, 3, 7, 7}));
+}
+
+void testLargeWeightsDoNotOverflow()
+{
+    Graph g(3);
+    g.addEdge(0, 1, numeric_limits<int>::max());
+    g.addEdge(1, 2, numeric_limits<int>::max());
+    for (HeapKind heap : {HeapKind::Binary, HeapKind::DAry, HeapKind::Radix}) {
+        customAssert(g.dijkstra(0, heap).dist[2] == 2 * Distance(numeric_limits<int>::max()));
+    }
+}
+
+void testInvalidEdgesThrow()
+{
+    Graph g(2);
+    bool  threw = false;
+    try {
+        g.addEdge(0, 1, -1);
+    } catch (const invalid_argument&) {
+        threw = true;
+    }
+    customAssert(threw);
+    threw = false;
+    try {
+        g.addEdge(0, 2, 1);
+    } catch (const out_of_range&) {
+        threw = true;
+    }
+    customAssert(threw);
+}
+
+void testDeltaSteppingMatchesDijkstra()
+{
+    for (unsigned seed = 1; seed <= 4; ++seed) {
+        auto             edges = randomEdges(500, 2500, seed % 2 ? 10 : 1000000, seed);
+        Graph            g(500, edges);
+        vector<Distance> expected = g.dijkstra(3).dist;
+        for (size_t threads : {1, 2, 4}) {
+            for (Distance delta : {Distance(0), Distance(1), Distance(5000000)}) {
+                ShortestPaths paths = g.deltaStepping(3, threads, delta);
+                customAssert(paths.dist == expected);
+                for (int v = 0; v < 500; ++v) {
+                    customAssert(paths.path(v).front() == 3);
+                    customAssert(v == 3 || paths.dist[paths.parent[v]] < paths.dist[v]);
+                }
+            }
+        }
+    }
+}
+
+void testDeltaSteppingOutlierWeight()
+{
+    // One huge weight with delta 1 would need 2^31 buckets if the cycle were not capped. Vertex
+    // 2001 is first reached through the outlier and later through the end of the path.
+    const int n = 2000;
+    Graph     g(n + 2);
+    for (int v = 0; v + 1 < n; ++v) {
+        g.addEdge(v, v + 1, 1);
+    }
+    g.addEdge(0, n, numeric_limits<int>::max());
+    g.addEdge(0, n + 1, numeric_limits<int>::max());
+    g.addEdge(n - 1, n + 1, 5);
+    vector<Distance> expected = g.dijkstra(0).dist;
+    customAssert(expected[n] == numeric_limits<int>::max() && expected[n + 1] == n + 4);
+    for (size_t threads : {1, 3}) {
+        customAssert(g.deltaStepping(0, threads, 1).dist == expected);
+    }
+}
+
+void testDeltaSteppingZeroWeightsAndUnreachable()
+{
+    Graph g(6);
+    g.addEdge(0, 1, 3);
+    g.addEdge(1, 2, 0);
+    g.addEdge(2, 3, 0);
+    g.addEdge(3, 1, 0);
+    g.addEdge(4, 5, 1);
+    for (size_t threads : {1, 3}) {
+        ShortestPaths paths = g.deltaStepping(0, threads, 2);
+        customAssert(paths.dist == vector<Distance>({0, 3, 3, 3, INF, INF}));
+        customAssert(paths.path(3).front() == 0 && paths.path(5).empty());
+    }
+    customAssert(g.suggestedDelta() >= 1);
+}
+
+void testContractionHierarchyMatchesDijkstra()
+{
+    // A grid with an isolated vertex, and a random graph with parallel edges and self loops
+    auto  grid = gridEdges(15, 100, 3);
+    Graph g1(15 * 15 + 1, grid);
+    auto  random = randomEdges(200, 700, 50, 4);
+    random.push_back({5, 5, 1});
+    random.push_back({1, 2, 1});
+    random.push_back({1, 2, 7});
+    Graph g2(200, random);
+    for (Graph* g : {&g1, &g2}) {
+        ContractionHierarchy ch(*g);
+        customAssert(ch.vertexCount() == g->vertexCount());
+        for (int source : {0, 17, 99}) {
+            ShortestPaths paths = g->dijkstra(source);
+            for (int target = 0; target < g->vertexCount(); ++target) {
+                customAssert(ch.distance(source, target) == paths.dist[target]);
+            }
+        }
+    }
+}
+
+void testContractionHierarchyFileRoundTrip()
+{
+    Graph                g(400, gridEdges(20, 1000, 9));
+    ContractionHierarchy built(g);
+    string               path = "/tmp/djikstra_ch_test.bin";
+    built.save(path);
+    ContractionHierarchy loaded = ContractionHierarchy::load(path);
+    customAssert(loaded.indexBytes() == built.indexBytes());
+    customAssert(loaded.shortcutCount() == built.shortcutCount());
+    for (int target = 0; target < 400; target += 7) {
+        customAssert(loaded.distance(21, target) == g.dijkstra(21).dist[target]);
+    }
+
+    // A truncated file is rejected rather than read past its end
+    truncate(path.c_str(), built.indexBytes() - 8);
+    bool threw = false;
+    try {
+        ContractionHierarchy::load(path);
+    } catch (const runtime_error&) {
+        threw = true;
+    }
+    customAssert(threw);
+    unlink(path.c_str());
+}
+
+void testDistanceMatrixMatchesDijkstra()
+{
+    // Vertices 300 .. 309 form a second component, so stale distances from reused scratch show
+    auto edges = randomEdges(300, 900, 100, 11);
+    for (int v = 301; v < 310; ++v) {
+        edges.push_back({v - 1, v, 5});
+    }
+    Graph       g(310, edges);
+    vector<int> sources = {0, 305, 17, 300, 299, 0, 150};
+    vector<int> targets = {309, 0, 1, 2, 150, 301, 42};
+    for (size_t threads : {1, 3}) {
+        vector<Distance> matrix = g.distanceMatrix(sources, targets, threads);
+        customAssert(matrix.size() == sources.size() * targets.size());
+        for (size_t i = 0; i < sources.size(); ++i) {
+            vector<Distance> expected = g.dijkstra(sources[i]).dist;
+            for (size_t j = 0; j < targets.size(); ++j) {
+                customAssert(matrix[i * targets.size() + j] == expected[targets[j]]);
+            }
+        }
+    }
+}
+
+void testForEachSourceStreamsEverySource()
+{
+    Graph          g(200, randomEdges(200, 600, 20, 5));
+    vector<int>    sources(50);
+    vector<size_t> reachedCount(50, 0);
+    for (int i = 0; i < 50; ++i) {
+        sources[i] = (i * 7) % 200;
+    }
+    g.forEachSource(
+        sources,
+        [&](size_t i, const SourceSearch& search) {
+            customAssert(search.source() == sources[i]);
+            customAssert(search.reached().front() == sources[i]);
+            customAssert(search.distance(search.reached().back()) >= search.distance(0));
+            reachedCount[i] = search.reached().size(); // Each index is visited by one worker
+        },
+        4);
+    customAssert(reachedCount == vector<size_t>(50, 200));
+
+    bool threw = false;
+    try {
+        g.forEachSource(
+            sources, [](size_t i, const SourceSearch&) {
+                if (i == 10) {
+                    throw runtime_error("callback failed");
+                }
+            },
+            2);
+    } catch (const runtime_error&) {
+        threw = true;
+    }
+    customAssert(threw);
+}
+
+void testIncrementalMatchesRecompute()
+{
+    auto                     edges = randomEdges(400, 1200, 100, 21);
+    Graph                    g(400, edges);
+    IncrementalShortestPaths tracker(g, 0);
+    mt19937                  rng(5);
+    vector<char>             gone(edges.size(), 0);
+    for (int round = 0; round < 60; ++round) {
+        vector<IncrementalShortestPaths::Update> batch;
+        for (int k = 0; k < 1 + round % 5; ++k) {
+            size_t edge = rng() % edges.size();
+            if (gone[edge]) {
+                continue;
+            }
+            // Equal numbers of heavier and lighter edges, and some removals that can disconnect
+            int kind = rng() % 3;
+            if (kind == 0 && !any_of(batch.begin(), batch.end(),
+                                     [edge](auto& update) { return update.edge == edge; })) {
+                batch.push_back({edge, 0, true});
+                gone[edge] = 1;
+            } else if (kind == 1) {
+                batch.push_back({edge, int(rng() % 1000)});
+            } else {
+                batch.push_back({edge, int(rng() % 20)});
+            }
+        }
+        tracker.apply(batch);
+        ShortestPaths expected = g.dijkstra(0, HeapKind::Binary);
+        customAssert(tracker.paths().dist == expected.dist);
+        for (int v = 0; v < 400; ++v) {
+            vector<int> path = tracker.paths().path(v);
+            customAssert(expected.dist[v] == INF ? path.empty() : path.front() == 0);
+        }
+    }
+    customAssert(g.edgeCount() < edges.size());
+}
+
+void testEdgeUpdatesValidate()
+{
+    Graph  g(3);
+    size_t a = g.addEdge(0, 1, 5);
+    size_t b = g.addEdge(1, 2, 5);
+    g.addEdge(0, 2, 20);
+    customAssert(a == 0 && b == 1);
+    g.setWeight(a, 1); // Before the first build
+    customAssert(g.dijkstra(0).dist == vector<Distance>({0, 1, 6}));
+    g.removeEdge(b); // Patched in place after it
+    customAssert(g.dijkstra(0).dist == vector<Distance>({0, 1, 20}) && g.edgeCount() == 2);
+
+    IncrementalShortestPaths tracker(g, 0);
+    int                      failures = 0;
+    for (auto batch : {vector<IncrementalShortestPaths::Update>{{b, 3}},
+                       vector<IncrementalShortestPaths::Update>{{7, 3}},
+                       vector<IncrementalShortestPaths::Update>{{a, -2}},
+                       vector<IncrementalShortestPaths::Update>{{a, 0, true}, {a, 4}}}) {
+        try {
+            tracker.apply(batch);
+        } catch (const logic_error&) {
+            failures++;
+        }
+    }
+    customAssert(failures == 4);
+    customAssert(tracker.paths().dist == vector<Distance>({0, 1, 20})); // Nothing applied
+    tracker.apply({{a, 4}, {a, 0, true}});
+    customAssert(tracker.paths().dist == vector<Distance>({0, INF, 20}));
 }
 
 void runTests()
 {
     vector<string> testResults;
     testResults.push_back(runTest("testDjikstra", testDjikstra));
+    testResults.push_back(runTest("testHeapsAgreeWithReference", testHeapsAgreeWithReference));
+    testResults.push_back(runTest("testUnreachableAndRebuild", testUnreachableAndRebuild));
+    testResults.push_back(runTest("testLargeWeightsDoNotOverflow", testLargeWeightsDoNotOverflow));
+    testResults.push_back(runTest("testInvalidEdgesThrow", testInvalidEdgesThrow));
+    testResults.push_back(
+        runTest("testDeltaSteppingMatchesDijkstra", testDeltaSteppingMatchesDijkstra));
+    testResults.push_back(
+        runTest("testDeltaSteppingOutlierWeight", testDeltaSteppingOutlierWeight));
+    testResults.push_back(runTest("testDeltaSteppingZeroWeightsAndUnreachable",
+                                  testDeltaSteppingZeroWeightsAndUnreachable));
+    testResults.push_back(runTest("testContractionHierarchyMatchesDijkstra",
+                                  testContractionHierarchyMatchesDijkstra));
+    testResults.push_back(runTest("testContractionHierarchyFileRoundTrip",
+                                  testContractionHierarchyFileRoundTrip));
+    testResults.push_back(
+        runTest("testDistanceMatrixMatchesDijkstra", testDistanceMatrixMatchesDijkstra));
+    testResults.push_back(
+        runTest("testForEachSourceStreamsEverySource", testForEachSourceStreamsEverySource));
+    testResults.push_back(
+        runTest("testIncrementalMatchesRecompute", testIncrementalMatchesRecompute));
+    testResults.push_back(runTest("testEdgeUpdatesValidate", testEdgeUpdatesValidate));
 
     // Print test results
     for (const auto& result : testResults) {
@@ -88,8 +1834,166 @@ void runTests()
     }
 }
 
-int main()
+// Build time, CSR footprint, one full search per heap and delta-stepping on 1 and `threads`
+// threads, on a random road-sized graph
+void benchmark(int vertices, size_t edges, size_t threads)
+{
+    auto  input = randomEdges(vertices, edges, 1000, 1);
+    auto  start = chrono::steady_clock::now();
+    Graph g(vertices, input);
+    g.build();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "vertices: " << vertices << ", edges: " << edges << ", build seconds: " << seconds
+         << ", CSR MB: " << g.memoryBytes() / 1e6 << endl;
+
+    const pair<HeapKind, const char*> heaps[] = {
+        {HeapKind::Binary, "binary"}, {HeapKind::DAry, "4-ary"}, {HeapKind::Radix, "radix"}};
+    for (const auto& heap : heaps) {
+        start               = chrono::steady_clock::now();
+        ShortestPaths paths = g.dijkstra(0, heap.first);
+        seconds             = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << heap.second << ": seconds " << seconds << ", dist[last] "
+             << paths.dist[vertices - 1] << endl;
+    }
+
+    cout << "delta-stepping, delta " << g.suggestedDelta() << endl;
+    for (size_t workers : {size_t(1), threads}) {
+        start               = chrono::steady_clock::now();
+        ShortestPaths paths = g.deltaStepping(0, workers);
+        seconds             = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << workers << " threads: seconds " << seconds << ", dist[last] "
+             << paths.dist[vertices - 1] << endl;
+    }
+}
+
+// Preprocessing time, index size, map time and query latency against plain Dijkstra on a grid
+void benchmarkContraction(int side, int queries)
+{
+    int   vertices = side * side;
+    Graph g(vertices, gridEdges(side, 1000, 1));
+    auto  start = chrono::steady_clock::now();
+    ContractionHierarchy built(g);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "vertices: " << vertices << ", edges: " << g.edgeCount() << ", build seconds: "
+         << seconds << ", shortcuts: " << built.shortcutCount()
+         << ", index MB: " << built.indexBytes() / 1e6 << endl;
+
+    string path = "/tmp/djikstra_ch_bench.bin";
+    built.save(path);
+    start                       = chrono::steady_clock::now();
+    ContractionHierarchy loaded = ContractionHierarchy::load(path);
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "load (mmap) microseconds: " << seconds * 1e6 << endl;
+
+    mt19937  rng(2);
+    Distance checksum = 0;
+    start             = chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        checksum += loaded.distance(rng() % vertices, rng() % vertices);
+    }
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "CH query microseconds: " << seconds * 1e6 / queries << " (checksum " << checksum
+         << ")" << endl;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < 10; ++i) {
+        g.dijkstra(rng() % vertices, HeapKind::Radix);
+    }
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Dijkstra query microseconds: " << seconds * 1e6 / 10 << endl;
+    unlink(path.c_str());
+}
+
+// Repeated dijkstra() calls against one distanceMatrix() batch over the same sources. Searches
+// in the batch stop once every target is settled, so few targets make them cheaper.
+void benchmarkBatch(int vertices, size_t edges, int sources, size_t threads, int targets)
+{
+    Graph g(vertices, randomEdges(vertices, edges, 1000, 1));
+    g.build();
+    mt19937     rng(3);
+    vector<int> from(sources), to(targets);
+    for (int& v : from) {
+        v = rng() % vertices;
+    }
+    for (int& v : to) {
+        v = rng() % vertices;
+    }
+
+    auto     start    = chrono::steady_clock::now();
+    Distance checksum = 0;
+    for (int source : from) {
+        checksum += g.dijkstra(source, HeapKind::Radix).dist[to[0]];
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "dijkstra() per source: " << sources / seconds << " sources/s (checksum " << checksum
+         << ")" << endl;
+
+    start                   = chrono::steady_clock::now();
+    vector<Distance> matrix = g.distanceMatrix(from, to, threads);
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    checksum = 0;
+    for (int i = 0; i < sources; ++i) {
+        checksum += matrix[i * to.size()];
+    }
+    cout << "distanceMatrix, " << targets << " targets, " << threads
+         << " threads: " << sources / seconds
+         << " sources/s (checksum " << checksum << ")" << endl;
+}
+
+// Incremental repair against a full radix-heap Dijkstra after each small batch of updates
+void benchmarkDynamic(int vertices, size_t edges, int batchSize, int rounds)
+{
+    Graph g(vertices, randomEdges(vertices, edges, 1000, 1));
+    IncrementalShortestPaths tracker(g, 0);
+    mt19937                  rng(4);
+    double                   repairSeconds = 0, fullSeconds = 0;
+    size_t                   repaired      = 0;
+    bool                     agree         = true;
+    for (int round = 0; round < rounds; ++round) {
+        vector<IncrementalShortestPaths::Update> batch;
+        for (int k = 0; k < batchSize; ++k) {
+            batch.push_back({rng() % edges, int(1 + rng() % 1000)});
+        }
+        auto start = chrono::steady_clock::now();
+        tracker.apply(batch);
+        repairSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        repaired += tracker.lastRepairSize();
+
+        start               = chrono::steady_clock::now();
+        ShortestPaths paths = g.dijkstra(0, HeapKind::Radix);
+        fullSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        agree = agree && paths.dist == tracker.paths().dist;
+    }
+    cout << "vertices: " << vertices << ", edges: " << edges << ", batch: " << batchSize << endl;
+    cout << "incremental ms per batch: " << repairSeconds * 1e3 / rounds
+         << ", vertices re-settled: " << repaired / rounds << endl;
+    cout << "full recomputation ms: " << fullSeconds * 1e3 / rounds
+         << ", results agree: " << (agree ? "yes" : "no") << endl;
+}
+
+int main(int argc, char* argv[])
 {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        size_t threads = argc > 4 ? stoull(argv[4]) : max(1u, thread::hardware_concurrency());
+        benchmark(argc > 2 ? stoi(argv[2]) : 1000000, argc > 3 ? stoull(argv[3]) : 5000000,
+                  threads);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-ch") {
+        benchmarkContraction(argc > 2 ? stoi(argv[2]) : 300, argc > 3 ? stoi(argv[3]) : 100000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-batch") {
+        size_t threads = argc > 5 ? stoull(argv[5]) : max(1u, thread::hardware_concurrency());
+        benchmarkBatch(argc > 2 ? stoi(argv[2]) : 100000, argc > 3 ? stoull(argv[3]) : 500000,
+                       argc > 4 ? stoi(argv[4]) : 200, threads, argc > 6 ? stoi(argv[6]) : 1000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-dynamic") {
+        benchmarkDynamic(argc > 2 ? stoi(argv[2]) : 1000000, argc > 3 ? stoull(argv[3]) : 5000000,
+                         argc > 4 ? stoi(argv[4]) : 10, argc > 5 ? stoi(argv[5]) : 20);
+        return 0;
+    }
     runTests();
 
     return 0;
@@ -1,10 +1,8 @@
-#include <chrono>
-#include <cmath>
-#include <deque>
 #include <iostream>
-#include <mutex>
-#include <unordered_map>
+#include <string>
 #include <vector>
+#include "market_data.h"
+#include "test_runner.h"
 
 using namespace std;
 
@@ -29,101 +27,140 @@ Time Complexity:
 "Can you improve the cleanup_old_ticks() time complexity while maintaining thread safety?"
 */
 
-struct TickData {
-    double price;
-    int    timestamp;
-    double volume;
-};
-
-class MarketData
+void testTopKByVolume()
 {
-    struct SymbolStats {
-        deque<TickData> tickWindow;
-        deque<double>   squaredReturnsWindow;
-        double          sumPrice{0.0};
-        double          sumVolume{0.0};
-        double          sumSquaredReturns{0.0};
-        double          previousPrice{0.0};
-        mutex           mtx;
-    };
-
-    unordered_map<string, SymbolStats> symbolData;
-    const double                       ANOMALY_THRESHOLD = 0.1; // 10% price change threshold
-
-   public:
-    void process_tick(const string& symbol, double price, int timestamp, double volume = 1.0)
-    {
-        auto&             stats = symbolData[symbol];
-        lock_guard<mutex> lock(stats.mtx);
-
-        // Anomaly detection
-        if (stats.previousPrice > 0) {
-            double priceChange = abs(price - stats.previousPrice) / stats.previousPrice;
-            if (priceChange > ANOMALY_THRESHOLD) {
-                // Handle anomaly - could log, reject, or adjust
-                return;
-            }
-        }
-
-        // Update rolling statistics
-        stats.tickWindow.push_back({price, timestamp, volume});
-        stats.sumPrice += price * volume;
-        stats.sumVolume += volume;
-
-        // Update volatility metrics
-        if (stats.previousPrice > 0) {
-            double return_       = log(price / stats.previousPrice);
-            double squaredReturn = return_ * return_;
-            stats.sumSquaredReturns += squaredReturn;
-            stats.squaredReturnsWindow.push_back(squaredReturn);
-        }
-        stats.previousPrice = price;
-
-        // Remove old ticks
-        cleanup_old_ticks(stats, timestamp);
-    }
-
-    double get_vwap(const string& symbol)
-    {
-        auto&             stats = symbolData[symbol];
-        lock_guard<mutex> lock(stats.mtx);
-
-        if (stats.sumVolume == 0)
-            return 0.0;
-        return stats.sumPrice / stats.sumVolume;
-    }
+    MarketData md;
+    md.process_tick("AAPL", 100.0, 0, 10.0);
+    md.process_tick("MSFT", 200.0, 0, 30.0);
+    md.process_tick("GOOG", 150.0, 0, 20.0);
+    md.process_tick("AAPL", 101.0, 1, 25.0);
+
+    auto top = md.top_k(Metric::Volume, 2);
+    customAssert(top.size() == 2);
+    customAssert(top[0].symbol == "AAPL" && top[0].value == 35.0);
+    customAssert(top[1].symbol == "MSFT" && top[1].value == 30.0);
+}
+
+void testTopKByReturn()
+{
+    MarketData md;
+    md.process_tick("AAPL", 100.0, 0);
+    md.process_tick("AAPL", 105.0, 1);
+    md.process_tick("MSFT", 100.0, 0);
+    md.process_tick("MSFT", 95.0, 1);
+    md.process_tick("GOOG", 100.0, 0);
 
-    double get_price_volatility(const string& symbol, size_t window_ticks)
-    {
-        auto&             stats = symbolData[symbol];
-        lock_guard<mutex> lock(stats.mtx);
+    auto gainers = md.top_k(Metric::Return, 1);
+    customAssert(gainers.size() == 1 && gainers[0].symbol == "AAPL");
 
-        if (stats.squaredReturnsWindow.size() < 2)
-            return 0.0;
+    auto losers = md.top_k(Metric::Return, 1, false);
+    customAssert(losers.size() == 1 && losers[0].symbol == "MSFT");
+}
 
-        // Adjust sumSquaredReturns to reflect only the last window_ticks returns
-        while (stats.squaredReturnsWindow.size() > window_ticks) {
-            stats.sumSquaredReturns -= stats.squaredReturnsWindow.front();
-            stats.squaredReturnsWindow.pop_front();
+void testTopKRekeysOnUpdate()
+{
+    MarketData md;
+    md.process_tick("AAPL", 100.0, 0, 10.0);
+    md.process_tick("MSFT", 100.0, 0, 20.0);
+    customAssert(md.top_k(Metric::Volume, 1)[0].symbol == "MSFT");
+
+    // Old volume ages out of the window, AAPL overtakes MSFT
+    md.process_tick("AAPL", 100.0, 4000, 50.0);
+    auto top = md.top_k(Metric::Volume, 5);
+    customAssert(top.size() == 2);
+    customAssert(top[0].symbol == "AAPL" && top[0].value == 50.0);
+    customAssert(md.get_vwap("AAPL") == 100.0);
+}
+
+void testTopKVwapSpreadAndVolatility()
+{
+    MarketData md;
+    md.process_tick("AAPL", 100.0, 0, 1.0);
+    md.process_tick("AAPL", 104.0, 1, 1.0);
+    md.process_tick("AAPL", 100.0, 2, 1.0);
+    md.process_tick("MSFT", 100.0, 0, 1.0);
+    md.process_tick("MSFT", 100.0, 1, 1.0);
+    md.process_tick("MSFT", 100.0, 2, 1.0);
+
+    customAssert(md.top_k(Metric::Volatility, 1)[0].symbol == "AAPL");
+    customAssert(md.top_k(Metric::Volatility, 1, false)[0].value == 0.0);
+    customAssert(md.top_k(Metric::VwapSpread, 1, false)[0].symbol == "AAPL");
+}
+
+// Returns leave the volatility ranking with their ticks, and reading a shorter volatility
+// window does not change what is ranked
+void testTopKVolatilityFollowsWindow()
+{
+    MarketData md;
+    md.process_tick("AAPL", 100.0, 0);
+    md.process_tick("AAPL", 105.0, 1);
+    md.process_tick("AAPL", 100.0, 2);
+    md.process_tick("MSFT", 100.0, 0);
+    md.process_tick("MSFT", 101.0, 1);
+    md.process_tick("MSFT", 100.0, 2);
+    customAssert(md.top_k(Metric::Volatility, 1)[0].symbol == "AAPL");
+
+    double ranked = md.top_k(Metric::Volatility, 1)[0].value;
+    customAssert(md.get_price_volatility("AAPL", 1) == 0.0);
+    customAssert(md.get_price_volatility("AAPL", 10) == ranked);
+    md.process_tick("MSFT", 100.0, 3);
+    customAssert(md.top_k(Metric::Volatility, 1)[0].value == ranked);
+
+    // An hour later AAPL's swings have aged out while MSFT keeps moving
+    md.process_tick("AAPL", 100.0, 4000);
+    md.process_tick("AAPL", 100.0, 4001);
+    md.process_tick("MSFT", 102.0, 4000);
+    md.process_tick("MSFT", 100.0, 4001);
+    auto top = md.top_k(Metric::Volatility, 2);
+    customAssert(top[0].symbol == "MSFT" && top[1].symbol == "AAPL" && top[1].value == 0.0);
+}
+
+// Zero, negative and non-finite inputs are dropped before they can reach a rank index
+void testTopKRejectsBadTicks()
+{
+    MarketData md;
+    md.process_tick("ZERO", 0.0, 0);
+    md.process_tick("ZERO", 10.0, 1);
+    md.process_tick("NAN", nan(""), 0);
+    md.process_tick("NEG", -5.0, 0);
+    md.process_tick("INF", 10.0, 0, numeric_limits<double>::infinity());
+    md.process_tick("AAPL", 100.0, 0);
+    md.process_tick("AAPL", 102.0, 1);
+
+    auto ranked = md.top_k(Metric::Return, 10);
+    customAssert(ranked.size() == 2);
+    customAssert(ranked[0].symbol == "AAPL" && ranked[1].symbol == "ZERO");
+    for (size_t m = 0; m < static_cast<size_t>(Metric::Count); ++m) {
+        for (const auto& entry : md.top_k(static_cast<Metric>(m), 10)) {
+            customAssert(isfinite(entry.value));
         }
-
-        return sqrt(stats.sumSquaredReturns / (stats.squaredReturnsWindow.size() - 1));
     }
+    // Re-keying after the rejected ticks still finds and replaces the old entries
+    md.process_tick("ZERO", 10.5, 2);
+    customAssert(md.top_k(Metric::Return, 10).size() == 2);
+    customAssert(md.top_k(Metric::Return, 1)[0].symbol == "ZERO");
+}
 
-   private:
-    void cleanup_old_ticks(SymbolStats& stats, int currentTime)
-    {
-        while (!stats.tickWindow.empty() &&
-               currentTime - stats.tickWindow.front().timestamp > 3600) {
-            const auto& oldTick = stats.tickWindow.front();
-            stats.sumPrice -= oldTick.price * oldTick.volume;
-            stats.sumVolume -= oldTick.volume;
-            stats.tickWindow.pop_front();
-        }
+void runTests()
+{
+    vector<string> testResults;
+    testResults.push_back(runTest("testTopKByVolume", testTopKByVolume));
+    testResults.push_back(runTest("testTopKByReturn", testTopKByReturn));
+    testResults.push_back(runTest("testTopKRekeysOnUpdate", testTopKRekeysOnUpdate));
+    testResults.push_back(
+        runTest("testTopKVwapSpreadAndVolatility", testTopKVwapSpreadAndVolatility));
+    testResults.push_back(
+        runTest("testTopKVolatilityFollowsWindow", testTopKVolatilityFollowsWindow));
+    testResults.push_back(runTest("testTopKRejectsBadTicks", testTopKRejectsBadTicks));
+
+    // Print test results
+    for (const auto& result : testResults) {
+        cout << result << endl;
     }
-};
+}
 
 int main()
 {
+    runTests();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TickData {
+    double price;
+    int    timestamp;
+    double volume;
+};
+
+// Cross-sectional metrics kept ranked across all symbols as ticks arrive
+enum class Metric { Return, Volume, Volatility, VwapSpread, Count };
+
+struct RankEntry {
+    std::string symbol;
+    double      value;
+};
+
+class MarketData
+{
+    struct SymbolStats {
+        std::deque<TickData> tickWindow;
+        // Squared log return of each tick against the one before it, tagged with the tick's
+        // timestamp so it leaves the window together with the tick
+        std::deque<std::pair<int, double>> squaredReturnsWindow;
+        double                             sumPrice{0.0};
+        double                             sumVolume{0.0};
+        double                             sumSquaredReturns{0.0};
+        double                             previousPrice{0.0};
+        double                             rankValues[static_cast<size_t>(Metric::Count)]{};
+        bool                               ranked{false};
+        std::mutex                         mtx;
+    };
+
+    // Orders by metric value, ties broken by symbol so rankings are deterministic
+    struct RankLess {
+        bool operator()(const std::pair<double, const std::string*>& a,
+                        const std::pair<double, const std::string*>& b) const
+        {
+            if (a.first != b.first)
+                return a.first < b.first;
+            return *a.second < *b.second;
+        }
+    };
+    using RankIndex = std::set<std::pair<double, const std::string*>, RankLess>;
+
+    std::unordered_map<std::string, SymbolStats> symbolData;
+
+    const double ANOMALY_THRESHOLD = 0.1; // 10% price change threshold
+
+    // One ordered index per metric, each with its own lock; each tick re-keys only its own
+    // symbol, O(log N) per metric
+    RankIndex  rankIndexes[static_cast<size_t>(Metric::Count)];
+    std::mutex rankMutexes[static_cast<size_t>(Metric::Count)];
+
+   public:
+    void process_tick(const std::string& symbol, double price, int timestamp, double volume = 1.0)
+    {
+        auto                        entry = symbolData.try_emplace(symbol).first;
+        auto&                       stats = entry->second;
+        std::lock_guard<std::mutex> lock(stats.mtx);
+
+        // A non-positive or non-finite price would make returns infinite or NaN, and a NaN key
+        // breaks the ordering of the rank indexes
+        if (!std::isfinite(price) || price <= 0 || !std::isfinite(volume) || volume < 0)
+            return;
+
+        // Anomaly detection
+        if (stats.previousPrice > 0) {
+            double priceChange = std::abs(price - stats.previousPrice) / stats.previousPrice;
+            if (priceChange > ANOMALY_THRESHOLD) {
+                // Handle anomaly - could log, reject, or adjust
+                return;
+            }
+        }
+
+        // Update rolling statistics
+        stats.tickWindow.push_back({price, timestamp, volume});
+        stats.sumPrice += price * volume;
+        stats.sumVolume += volume;
+
+        // Update volatility metrics
+        if (stats.previousPrice > 0) {
+            double return_       = std::log(price / stats.previousPrice);
+            double squaredReturn = return_ * return_;
+            stats.sumSquaredReturns += squaredReturn;
+            stats.squaredReturnsWindow.push_back({timestamp, squaredReturn});
+        }
+        stats.previousPrice = price;
+
+        // Remove old ticks
+        cleanup_old_ticks(stats, timestamp);
+
+        // Refresh this symbol's position in the cross-sectional rankings
+        update_rankings(entry->first, stats);
+    }
+
+    // Top k symbols for a metric, highest first unless descending is false. Cost is O(k)
+    // regardless of how many symbols are tracked.
+    std::vector<RankEntry> top_k(Metric metric, size_t k, bool descending = true)
+    {
+        std::lock_guard<std::mutex> lock(rankMutexes[static_cast<size_t>(metric)]);
+        const auto&                 index = rankIndexes[static_cast<size_t>(metric)];
+
+        std::vector<RankEntry> result;
+        result.reserve(std::min(k, index.size()));
+        auto collect = [&](auto it, auto end) {
+            for (; it != end && result.size() < k; ++it) {
+                result.push_back({*it->second, it->first});
+            }
+        };
+        if (descending)
+            collect(index.rbegin(), index.rend());
+        else
+            collect(index.begin(), index.end());
+        return result;
+    }
+
+    double get_vwap(const std::string& symbol)
+    {
+        auto&                       stats = symbolData[symbol];
+        std::lock_guard<std::mutex> lock(stats.mtx);
+
+        if (stats.sumVolume == 0)
+            return 0.0;
+        return stats.sumPrice / stats.sumVolume;
+    }
+
+    // Volatility over the last window_ticks returns still in the time window. Read-only, so it
+    // does not disturb the window the Volatility ranking is computed over.
+    double get_price_volatility(const std::string& symbol, size_t window_ticks)
+    {
+        auto&                       stats = symbolData[symbol];
+        std::lock_guard<std::mutex> lock(stats.mtx);
+
+        const auto& returns = stats.squaredReturnsWindow;
+        size_t      count   = std::min(window_ticks, returns.size());
+        if (count < 2)
+            return 0.0;
+
+        double sum = 0.0;
+        if (count == returns.size()) {
+            sum = stats.sumSquaredReturns;
+        } else {
+            for (auto it = returns.end() - count; it != returns.end(); ++it)
+                sum += it->second;
+        }
+        return std::sqrt(sum / (count - 1));
+    }
+
+   private:
+    void cleanup_old_ticks(SymbolStats& stats, int currentTime)
+    {
+        while (!stats.tickWindow.empty() &&
+               currentTime - stats.tickWindow.front().timestamp > 3600) {
+            const auto& oldTick = stats.tickWindow.front();
+            stats.sumPrice -= oldTick.price * oldTick.volume;
+            stats.sumVolume -= oldTick.volume;
+            stats.tickWindow.pop_front();
+        }
+        while (!stats.squaredReturnsWindow.empty() &&
+               currentTime - stats.squaredReturnsWindow.front().first > 3600) {
+            stats.sumSquaredReturns -= stats.squaredReturnsWindow.front().second;
+            stats.squaredReturnsWindow.pop_front();
+        }
+        if (stats.squaredReturnsWindow.empty())
+            stats.sumSquaredReturns = 0.0; // Drop accumulated rounding error
+    }
+
+    // Caller holds stats.mtx
+    void update_rankings(const std::string& symbol, SymbolStats& stats)
+    {
+        double values[static_cast<size_t>(Metric::Count)];
+
+        double firstPrice = stats.tickWindow.front().price;
+        double vwap       = stats.sumVolume > 0 ? stats.sumPrice / stats.sumVolume : 0.0;
+        size_t returns    = stats.squaredReturnsWindow.size();
+
+        values[static_cast<size_t>(Metric::Return)] = stats.previousPrice / firstPrice - 1.0;
+        values[static_cast<size_t>(Metric::Volume)] = stats.sumVolume;
+        values[static_cast<size_t>(Metric::Volatility)] =
+            returns < 2 ? 0.0 : std::sqrt(stats.sumSquaredReturns / (returns - 1));
+        values[static_cast<size_t>(Metric::VwapSpread)] =
+            vwap > 0 ? (stats.previousPrice - vwap) / vwap : 0.0;
+
+        for (size_t m = 0; m < static_cast<size_t>(Metric::Count); ++m) {
+            if (!std::isfinite(values[m]))
+                values[m] = 0.0; // RankLess needs a strict weak order, which NaN breaks
+            std::lock_guard<std::mutex> lock(rankMutexes[m]);
+            if (stats.ranked) {
+                if (stats.rankValues[m] == values[m])
+                    continue;
+                rankIndexes[m].erase({stats.rankValues[m], &symbol});
+            }
+            rankIndexes[m].insert({values[m], &symbol});
+            stats.rankValues[m] = values[m];
+        }
+        stats.ranked = true;
+    }
+};
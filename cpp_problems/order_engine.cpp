@@ -11,256 +11,11 @@
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
+#include "order_book.h"
 #include "test_runner.h"
 
 using namespace std;
 
-class Order
-{
-   public:
-    int    orderId;
-    bool   isBuy;
-    double price; // Price for limit orders, ignored for market orders
-    int    quantity;
-    bool   fillOrKill; // True for fill-or-kill orders
-    chrono::time_point<chrono::steady_clock> timestamp;
-
-    // Default constructor
-    Order()
-        : orderId(0),
-          isBuy(false),
-          price(0.0),
-          quantity(0),
-          fillOrKill(false),
-          timestamp(chrono::steady_clock::now())
-    {
-    }
-
-    // Parameterized constructor
-    Order(int id, bool buy, double p, int q, bool fok)
-        : orderId(id),
-          isBuy(buy),
-          price(p),
-          quantity(q),
-          fillOrKill(fok),
-          timestamp(chrono::steady_clock::now())
-    {
-    }
-
-    // Copy constructor
-    Order(const Order& other)
-        : orderId(other.orderId),
-          isBuy(other.isBuy),
-          price(other.price),
-          quantity(other.quantity),
-          fillOrKill(other.fillOrKill),
-          timestamp(other.timestamp)
-    {
-    }
-
-    // Move constructor
-    Order(Order&& other) noexcept
-        : orderId(other.orderId),
-          isBuy(other.isBuy),
-          price(other.price),
-          quantity(other.quantity),
-          fillOrKill(other.fillOrKill),
-          timestamp(move(other.timestamp))
-    {
-        other.orderId    = 0;
-        other.isBuy      = false;
-        other.price      = 0.0;
-        other.quantity   = 0;
-        other.fillOrKill = false;
-    }
-
-    // Copy assignment operator
-    Order& operator=(const Order& other)
-    {
-        if (this != &other) {
-            orderId    = other.orderId;
-            isBuy      = other.isBuy;
-            price      = other.price;
-            quantity   = other.quantity;
-            fillOrKill = other.fillOrKill;
-            timestamp  = other.timestamp;
-        }
-        return *this;
-    }
-
-    // Move assignment operator
-    Order& operator=(Order&& other) noexcept
-    {
-        if (this != &other) {
-            orderId    = other.orderId;
-            isBuy      = other.isBuy;
-            price      = other.price;
-            quantity   = other.quantity;
-            fillOrKill = other.fillOrKill;
-            timestamp  = move(other.timestamp);
-
-            other.orderId    = 0;
-            other.isBuy      = false;
-            other.price      = 0.0;
-            other.quantity   = 0;
-            other.fillOrKill = false;
-        }
-        return *this;
-    }
-};
-
-class OrderBook
-{
-    struct OrderNode {
-        Order                     order;
-        list<OrderNode>::iterator it;
-        list<OrderNode>*          orderList; // Pointer to the list
-
-        OrderNode(const Order& o) : order(o), orderList(nullptr) {}
-        OrderNode() : order(0, false, 0.0, 0, false), orderList(nullptr) {} // Default constructor
-    };
-
-   public:
-    // Price -> List of orders at that price
-    map<double, list<OrderNode>>  buyOrders;
-    map<double, list<OrderNode>>  sellOrders;
-    unordered_map<int, OrderNode> orderLookup;
-
-   private:
-    mutex bookMutex; // For thread safety (if required)
-
-    // Helper function to delete empty levels
-    void deleteEmptyLevels(bool isBuy, map<double, list<OrderNode>>& matchingSide)
-    {
-        if (isBuy) {
-            // Delete empty levels starting from begin for sellOrders
-            for (auto it = matchingSide.begin(); it != matchingSide.end();) {
-                if (it->second.empty()) {
-                    it = matchingSide.erase(it);
-                } else {
-                    break;
-                }
-            }
-        } else {
-            // Delete empty levels starting from rbegin for buyOrders (lowest)
-            for (auto it = matchingSide.rbegin(); it != matchingSide.rend();) {
-                if (it->second.empty()) {
-                    it = decltype(it)(matchingSide.erase(next(it).base()));
-                } else {
-                    break;
-                }
-            }
-        }
-    }
-
-    // Helper function to match orders
-    template <typename Iterator, typename Comparator>
-    void matchOrdersHelper(Order& incomingOrder, Iterator begin, Iterator end, Comparator comp)
-    {
-        for (auto it = begin; it != end; ++it) {
-            auto& orderList = it->second;
-            for (auto listIt = orderList.begin();
-                 listIt != orderList.end() && incomingOrder.quantity > 0;) {
-                auto& existingOrder = listIt->order;
-                if (comp(incomingOrder.price, existingOrder.price))
-                    return;
-
-                int tradeQuantity = min(incomingOrder.quantity, existingOrder.quantity);
-                incomingOrder.quantity -= tradeQuantity;
-                existingOrder.quantity -= tradeQuantity;
-
-                if (existingOrder.quantity == 0) {
-                    orderLookup.erase(existingOrder.orderId);
-                    listIt = orderList.erase(listIt);
-                    ++listIt;
-                } else {
-                    return;
-                }
-            }
-        }
-    }
-
-    // Match orders using price-time priority
-    void matchOrder(Order& incomingOrder)
-    {
-        auto& matchingSide = incomingOrder.isBuy ? sellOrders : buyOrders;
-        auto& sameSide     = incomingOrder.isBuy ? buyOrders : sellOrders;
-
-        if (!matchingSide.empty()) {
-            if (incomingOrder.isBuy)
-                // Start from the lowest price for sell orders
-                matchOrdersHelper(
-                    incomingOrder, matchingSide.begin(), matchingSide.end(), less<double>());
-            else
-                // Start from the highest price for buy orders
-                matchOrdersHelper(
-                    incomingOrder, matchingSide.rbegin(), matchingSide.rend(), greater<double>());
-
-            // Delete empty levels
-            deleteEmptyLevels(incomingOrder.isBuy, matchingSide);
-        }
-
-        // Handle remaining quantities for fill-or-kill orders
-        if (incomingOrder.fillOrKill && incomingOrder.quantity > 0) {
-            incomingOrder.quantity = 0; // Cancel the order
-            cout << "Fill-or-kill order ID " << incomingOrder.orderId << " was cancelled.\n";
-        }
-
-        // Add remaining quantities to the same side order book
-        if (incomingOrder.quantity > 0) {
-            OrderNode newNode(incomingOrder);
-            auto      it =
-                sameSide[incomingOrder.price].insert(sameSide[incomingOrder.price].end(), newNode);
-            newNode.it                         = it;
-            newNode.orderList                  = &sameSide[incomingOrder.price];
-            orderLookup[incomingOrder.orderId] = newNode;
-        }
-    }
-
-   public:
-    void processOrder(Order& order)
-    {
-        lock_guard<mutex> lock(bookMutex);
-
-        if (order.quantity <= 0)
-            return;
-
-        if (orderLookup.find(order.orderId) != orderLookup.end()) {
-            cerr << "Order ID " << order.orderId << " already exists.\n";
-            return;
-        }
-
-        // Match incoming order
-        matchOrder(order);
-    }
-
-    void cancelOrder(int orderId)
-    {
-        lock_guard<mutex> lock(bookMutex);
-
-        auto it = orderLookup.find(orderId);
-        if (it != orderLookup.end()) {
-            auto& orderNode = it->second;
-            auto& orderList = *orderNode.orderList;
-            orderList.erase(orderNode.it);
-
-            // Remove the price level if the list is empty
-            if (orderList.empty()) {
-                if (orderNode.order.isBuy) {
-                    buyOrders.erase(orderNode.order.price);
-                } else {
-                    sellOrders.erase(orderNode.order.price);
-                }
-            }
-
-            orderLookup.erase(it);
-            cout << "Order ID " << orderId << " was cancelled.\n";
-        } else {
-            cerr << "Order ID " << orderId << " not found.\n";
-        }
-    }
-};
-
 void testAddBuyOrder()
 {
     OrderBook orderBook;
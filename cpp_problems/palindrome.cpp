@@ -1,44 +1,622 @@
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include <array>
+#include <chrono>
+#include <random>
+#include <string_view>
 #include "template.h"
 #include "test_runner.h"
 
-string processString(const string& str)
+// Byte to its lowercase form when it is an ASCII letter or digit, 0 when it is dropped. Bytes
+// >= 0x80 map to 0 here; callers decode them as UTF-8 instead.
+constexpr array<char, 256> asciiFold = [] {
+    array<char, 256> table{};
+    for (int c = '0'; c <= '9'; ++c) {
+        table[c] = char(c);
+    }
+    for (int c = 'a'; c <= 'z'; ++c) {
+        table[c] = char(c);
+        table[c - 'a' + 'A'] = char(c);
+    }
+    return table;
+}();
+
+// Length of the well-formed UTF-8 sequence starting at p, or 0 when it is truncated or
+// malformed (overlong forms, surrogates and code points past U+10FFFF included).
+size_t utf8Length(const unsigned char* p, const unsigned char* end)
 {
-    string result = str;
+    size_t        length;
+    unsigned char lo = 0x80, hi = 0xBF; // Allowed range of the second byte
+    if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+        length = 2;
+    } else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+        length = 3;
+        lo     = p[0] == 0xE0 ? 0xA0 : lo;
+        hi     = p[0] == 0xED ? 0x9F : hi;
+    } else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+        length = 4;
+        lo     = p[0] == 0xF0 ? 0x90 : lo;
+        hi     = p[0] == 0xF4 ? 0x8F : hi;
+    } else {
+        return 0;
+    }
+    if (size_t(end - p) < length || p[1] < lo || p[1] > hi) {
+        return 0;
+    }
+    for (size_t k = 2; k < length; ++k) {
+        if ((p[k] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
 
-    // Remove non-whitespace and punctuation characters
-    result.erase(remove_if(result.begin(), result.end(), [](char c) { return !isalnum(c); }),
-                 result.end());
+// Normalizes the non-ASCII sequence at p into out and returns the bytes consumed. Latin-1
+// capitals fold to lowercase, Latin-1 punctuation and symbols (U+0080-U+00BF, U+00D7, U+00F7)
+// are dropped and other code points are copied whole. A malformed byte is dropped on its own,
+// so one bad byte cannot swallow the text after it.
+size_t foldUtf8(const unsigned char* p, const unsigned char* end, char*& out)
+{
+    size_t length = utf8Length(p, end);
+    if (length == 0) {
+        return 1;
+    }
+    if (p[0] == 0xC2 || (p[0] == 0xC3 && (p[1] == 0x97 || p[1] == 0xB7))) {
+        return length;
+    }
+    if (p[0] == 0xC3 && p[1] <= 0x9E) {
+        *out++ = char(0xC3);
+        *out++ = char(p[1] + 0x20);
+        return length;
+    }
+    memcpy(out, p, length);
+    out += length;
+    return length;
+}
 
-    // Convert to lowercase
-    transform(
-        result.begin(), result.end(), result.begin(), [](unsigned char c) { return tolower(c); });
+// Folds the character at p the way the normalizer does: one ASCII byte, one well-formed UTF-8
+// sequence or one malformed byte. Returns its length and sets key to the folded bytes packed
+// into an integer, 0 when the character is dropped.
+size_t foldCharacter(const unsigned char* p, const unsigned char* end, uint32_t& key)
+{
+    if (*p < 0x80) {
+        key = (unsigned char)asciiFold[*p];
+        return 1;
+    }
+    char   folded[4];
+    char*  out    = folded;
+    size_t length = foldUtf8(p, end, out);
+    key           = 0;
+    for (char* c = folded; c < out; ++c) {
+        key = key << 8 | (unsigned char)*c;
+    }
+    return length;
+}
 
+// Start of the character that ends at end, where begin is known to start one. A byte that is
+// not a continuation byte always starts a character, so the candidate is the nearest such
+// byte; it is the start only if its sequence runs exactly to end, otherwise the last byte is a
+// malformed one on its own.
+const unsigned char* characterStart(const unsigned char* begin, const unsigned char* end)
+{
+    const unsigned char* lead = end - 1;
+    if (*lead < 0x80) {
+        return lead;
+    }
+    while (lead > begin && end - lead < 4 && (*lead & 0xC0) == 0x80) {
+        lead--;
+    }
+    return utf8Length(lead, end) == size_t(end - lead) ? lead : end - 1;
+}
+
+// Two pointers over the original bytes comparing whole characters folded as processString
+// folds them, so the answer is the same as for the normalized text but nothing is copied.
+bool isPalindrome(string_view s)
+{
+    auto i = (const unsigned char*)s.data(), j = i + s.size();
+    while (true) {
+        uint32_t front = 0, back = 0;
+        size_t   frontLength = 0;
+        while (i < j) {
+            frontLength = foldCharacter(i, j, front);
+            if (front != 0) {
+                break;
+            }
+            i += frontLength;
+        }
+        const unsigned char* backStart = j;
+        while (i < j) {
+            backStart = characterStart(i, j);
+            foldCharacter(backStart, j, back);
+            if (back != 0) {
+                break;
+            }
+            j = backStart;
+        }
+        if (i + frontLength >= j) {
+            return true; // At most one character left
+        }
+        if (front != back) {
+            return false;
+        }
+        i += frontLength;
+        j = backStart;
+    }
+}
+
+// A normalize kernel writes the lowercased letters and digits of in[0, n) to out and returns
+// the new end of out. Output is never longer than the input, but kernels may store up to
+// normalizeSlack bytes past the end they return.
+using NormalizeKernel = char* (*)(const char* in, size_t n, char* out);
+constexpr size_t normalizeSlack = 32;
+
+char* normalizeScalar(const char* in, size_t n, char* out)
+{
+    auto p = (const unsigned char*)in, end = p + n;
+    while (p < end) {
+        if (*p < 0x80) {
+            char c = asciiFold[*p++];
+            *out   = c;
+            out += c != 0; // Branch-free drop of separators
+        } else {
+            p += foldUtf8(p, end, out);
+        }
+    }
+    return out;
+}
+
+#if defined(__x86_64__)
+// pshufb controls that pack the bytes selected by an 8-bit mask to the front of 8 bytes
+constexpr array<array<uint8_t, 8>, 256> packShuffles = [] {
+    array<array<uint8_t, 8>, 256> table{};
+    for (int mask = 0; mask < 256; ++mask) {
+        int k = 0;
+        for (int b = 0; b < 8; ++b) {
+            if (mask >> b & 1) {
+                table[mask][k++] = uint8_t(b);
+            }
+        }
+        for (; k < 8; ++k) {
+            table[mask][k] = 0x80;
+        }
+    }
+    return table;
+}();
+
+// Classifies and lowercases 32 bytes at a time. All-alphanumeric blocks, the common case for
+// identifiers, are stored as they are; others are packed 8 bytes at a time with a shuffle
+// table. A block with a non-ASCII byte handles its ASCII prefix the same way and hands the
+// sequence itself to foldUtf8.
+//
+// Identifiers are mostly shorter than a block, so a short tail is loaded as two overlapping
+// halves, its first and last 16 (or 8) bytes, rather than left to the scalar loop. The
+// overlap sits at byte gap of the block and is masked out of both keep and high.
+__attribute__((target("avx2,popcnt"))) char* normalizeAvx2(const char* in, size_t n, char* out)
+{
+    auto p = (const unsigned char*)in, end = p + n;
+    while (end - p >= 8) {
+        size_t  left = end - p, gap = 32, overlap = 0;
+        __m256i v;
+        if (left >= 32) {
+            v = _mm256_loadu_si256((const __m256i*)p);
+        } else if (left >= 16) {
+            gap     = 16;
+            overlap = 32 - left;
+            v = _mm256_set_m128i(_mm_loadu_si128((const __m128i*)(end - 16)),
+                                 _mm_loadu_si128((const __m128i*)p));
+        } else {
+            gap     = 8;
+            overlap = 16 - left;
+            __m128i head = _mm_loadl_epi64((const __m128i*)p);
+            __m128i last = _mm_loadl_epi64((const __m128i*)(end - 8));
+            v = _mm256_zextsi128_si256(_mm_unpacklo_epi64(head, last)); // Zero bytes are dropped
+        }
+        uint32_t valid  = overlap ? ~(((1u << overlap) - 1) << gap) : UINT32_MAX;
+        uint32_t high   = _mm256_movemask_epi8(v) & valid;
+        __m256i  lower  = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i  letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                           _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+        __m256i  digit  = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                           _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+        __m256i  folded = _mm256_blendv_epi8(v, lower, letter);
+        uint32_t keep   = _mm256_movemask_epi8(_mm256_or_si256(letter, digit)) & valid;
+        if (keep == UINT32_MAX) {
+            _mm256_storeu_si256((__m256i*)out, folded);
+            out += 32;
+            p += 32;
+            continue;
+        }
+        size_t consumed = min<size_t>(left, 32);
+        if (high) {
+            size_t first = __builtin_ctz(high);
+            consumed     = first < gap ? first : first - overlap;
+            keep &= (1u << first) - 1;
+        }
+        __m128i halves[2] = {_mm256_castsi256_si128(folded), _mm256_extracti128_si256(folded, 1)};
+        for (int group = 0; group < 4; ++group) {
+            uint32_t mask  = keep >> (8 * group) & 0xFF;
+            __m128i  bytes = group & 1 ? _mm_srli_si128(halves[group / 2], 8) : halves[group / 2];
+            __m128i  control = _mm_loadl_epi64((const __m128i*)packShuffles[mask].data());
+            _mm_storel_epi64((__m128i*)out, _mm_shuffle_epi8(bytes, control));
+            out += __builtin_popcount(mask);
+        }
+        p += consumed;
+        if (high) {
+            p += foldUtf8(p, end, out);
+        }
+    }
+    return normalizeScalar((const char*)p, end - p, out);
+}
+#endif
+
+NormalizeKernel normalizeKernel()
+{
+    static const NormalizeKernel kernel = [] {
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+            return normalizeAvx2;
+        }
+#endif
+        return normalizeScalar;
+    }();
+    return kernel;
+}
+
+// Keeps letters and digits, lowercased; see foldUtf8 for what happens to non-ASCII text
+string processString(string_view str)
+{
+    string result(str.size() + normalizeSlack, '\0');
+    result.resize(normalizeKernel()(str.data(), str.size(), result.data()) - result.data());
     return result;
 }
 
-bool isPalindrome(string s)
+// Normalized strings packed back to back in one buffer; entry i is text[ends[i - 1], ends[i]).
+// Reusing a batch keeps its capacity, so steady-state batches do not allocate.
+struct NormalizedBatch {
+    string         text;
+    vector<size_t> ends;
+
+    size_t size() const
+    {
+        return ends.size();
+    }
+
+    string_view operator[](size_t i) const
+    {
+        size_t begin = i == 0 ? 0 : ends[i - 1];
+        return string_view(text).substr(begin, ends[i] - begin);
+    }
+};
+
+// Normalizes every string in inputs (anything convertible to string_view) into out
+template <typename Strings>
+void normalizeInto(const Strings& inputs, NormalizedBatch& out,
+                   NormalizeKernel kernel = normalizeKernel())
+{
+    size_t total = 0;
+    for (const auto& input : inputs) {
+        total += string_view(input).size();
+    }
+    out.ends.clear();
+    out.ends.reserve(inputs.size());
+    out.text.resize(total + normalizeSlack);
+    char* base   = out.text.data();
+    char* cursor = base;
+    for (const auto& input : inputs) {
+        string_view s(input);
+        cursor = kernel(s.data(), s.size(), cursor);
+        out.ends.push_back(cursor - base);
+    }
+    out.text.resize(cursor - base);
+}
+
+// Manacher's algorithm over the bytes of a text, run once so that "is text[i..j] a
+// palindrome" is a single comparison afterwards. radius_ is indexed by centre in the text
+// interleaved with separators, #t0#t1#...#, where centre 2k + 1 is byte k and centre 2k is the
+// gap before it; radius_[c] is the length of the longest palindrome in the text centred at c.
+// Works on raw bytes, so normalize with processString first for case- and punctuation-blind
+// queries.
+class PalindromeIndex
 {
-    s = processString(s);
-    if (s.size() == 1)
+   public:
+    explicit PalindromeIndex(string_view text)
+    {
+        if (text.size() >= UINT32_MAX / 2) {
+            throw invalid_argument("PalindromeIndex: text too long");
+        }
+        size_t m = 2 * text.size() + 1;
+        // Separators sit at even positions; comparisons always pair equal parities
+        auto at = [&text](size_t k) { return k & 1 ? int((unsigned char)text[k / 2]) : -1; };
+        radius_.assign(m, 0);
+        size_t centre = 0, right = 0; // Rightmost palindrome found so far: [.., right]
+        for (size_t i = 0; i < m; ++i) {
+            size_t r = i < right ? min<size_t>(radius_[2 * centre - i], right - i) : 0;
+            while (r < i && i + r + 1 < m && at(i - r - 1) == at(i + r + 1)) {
+                r++;
+            }
+            radius_[i] = r;
+            if (i + r > right) {
+                centre = i;
+                right  = i + r;
+            }
+            if (r > radius_[longest_]) {
+                longest_ = i;
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return radius_.size() / 2;
+    }
+
+    // Whether text[i..j], both ends inclusive, reads the same backwards
+    bool isPalindrome(size_t i, size_t j) const
+    {
+        if (i > j || j >= size()) {
+            throw out_of_range("PalindromeIndex::isPalindrome: bad range");
+        }
+        return radius_[i + j + 1] >= j - i + 1;
+    }
+
+    // Leftmost longest palindromic substring as {start, length}; {0, 0} for an empty text
+    pair<size_t, size_t> longest() const
+    {
+        return {(longest_ - radius_[longest_]) / 2, radius_[longest_]};
+    }
+
+   private:
+    vector<uint32_t> radius_;
+    size_t           longest_ = 0;
+};
+
+// Palindromic tree (eertree) of a text fed one byte at a time: one node per distinct
+// palindromic substring plus two roots, of length -1 and 0. Each byte adds at most one node,
+// found by walking suffix links from the longest palindromic suffix, so building is linear
+// amortized. Children are kept as sibling lists since most nodes have one or two.
+class Eertree
+{
+   public:
+    Eertree()
+    {
+        nodes_.push_back({-1, 0, nil, nil, 0});
+        nodes_.push_back({0, 0, nil, nil, 0});
+    }
+
+    // Appends c and returns whether it ends a palindrome not seen before
+    bool push_back(char c)
+    {
+        text_.push_back(c);
+        uint32_t parent = suffixFor(last_, c);
+        if (uint32_t existing = child(parent, c); existing != nil) {
+            last_ = existing;
+            return false;
+        }
+        int32_t  length = nodes_[parent].length + 2;
+        uint32_t link   = length == 1 ? 1 : child(suffixFor(nodes_[parent].link, c), c);
+        nodes_.push_back({length, link, nil, nodes_[parent].firstChild, (unsigned char)c});
+        last_                     = nodes_.size() - 1;
+        nodes_[parent].firstChild = last_;
         return true;
-    int i = 0, j = s.size() - 1;
-    while (i <= j && s[i] == s[j]) {
-        i++;
-        j--;
     }
-    return i > j;
+
+    size_t distinct() const
+    {
+        return nodes_.size() - 2;
+    }
+
+    // Length of the longest palindrome ending at the last byte pushed
+    size_t longestSuffix() const
+    {
+        return max(nodes_[last_].length, 0);
+    }
+
+   private:
+    static constexpr uint32_t nil = UINT32_MAX;
+
+    struct Node {
+        int32_t       length;
+        uint32_t      link; // Longest proper palindromic suffix
+        uint32_t      firstChild, nextSibling;
+        unsigned char byte; // Byte on the edge from the parent
+    };
+
+    // Deepest palindrome on v's suffix-link chain that c extends on both sides
+    uint32_t suffixFor(uint32_t v, char c) const
+    {
+        size_t last = text_.size() - 1;
+        while (true) {
+            size_t length = nodes_[v].length; // -1 wraps, so it never fails the bound below
+            if (v == 0 || (length < last && text_[last - 1 - length] == c)) {
+                return v;
+            }
+            v = nodes_[v].link;
+        }
+    }
+
+    uint32_t child(uint32_t v, char c) const
+    {
+        uint32_t w = nodes_[v].firstChild;
+        while (w != nil && nodes_[w].byte != (unsigned char)c) {
+            w = nodes_[w].nextSibling;
+        }
+        return w;
+    }
+
+    vector<Node> nodes_;
+    string       text_;
+    uint32_t     last_ = 1;
+};
+
+size_t distinctPalindromes(string_view text)
+{
+    Eertree tree;
+    for (char c : text) {
+        tree.push_back(c);
+    }
+    return tree.distinct();
 }
 
 void testPalindrome()
 {
     customAssert(isPalindrome("racecar"));
     customAssert(isPalindrome("race car"));
+    customAssert(isPalindrome("A man, a plan, a canal: Panama"));
+    customAssert(isPalindrome(""));
+    customAssert(isPalindrome(" .,!"));
+    customAssert(isPalindrome("x"));
+    customAssert(isPalindrome("No 'x' in Nixon"));
+    // Characters fold as in processString, \xC3\x84 being Ä and \xC3\xA4 ä. NBSP and malformed
+    // bytes are dropped, including a sequence cut short before the last character.
+    customAssert(isPalindrome("ab_\xC3\xA9_BA"));
+    customAssert(isPalindrome("\xC3\x84x\xC3\xA4") && !isPalindrome("\xC3\x84x"));
+    customAssert(isPalindrome("\xE6\x97\xA5\xC2\xA0z\xE6\x97\xA5"));
+    customAssert(isPalindrome("\xC3\xA4\xA4") && isPalindrome("a\xFF\xE2\x82\xC3" "A"));
+    customAssert(isPalindrome("\xE6\x97\xA5\xE6\x97") && !isPalindrome("\xE6\x97\xA5z"));
+    customAssert(!isPalindrome("race a car"));
+    customAssert(!isPalindrome("0P"));
+    customAssert(!isPalindrome("ab"));
+}
+
+void testNormalize()
+{
+    customAssert(processString("Order_ID-42.v2") == "orderid42v2");
+    customAssert(processString("") == "");
+    customAssert(processString("__--..") == "");
+    // Latin-1 capitals fold, the multiplication sign and NBSP are dropped, CJK passes through
+    customAssert(processString("Stra\xC3\x9F\x65 \xC3\x84\xC3\x96\xC3\x9C\xC3\x97\x32") ==
+                 "stra\xC3\x9F\x65\xC3\xA4\xC3\xB6\xC3\xBC\x32");
+    customAssert(processString("a\xC2\xA0\xE6\x97\xA5Z") == "a\xE6\x97\xA5z");
+    // Malformed bytes, a surrogate and an overlong '/' are dropped byte by byte
+    customAssert(processString("ab\xFF\x63\xC3(d") == "abcd");
+    customAssert(processString("\xED\xA0\x80x\xC0\xAFy\xE6\x97") == "xy");
+
+    vector<string>  inputs = {"Alpha_1", "", "BETA-two", "\xC3\x89t\xC3\xA9"};
+    NormalizedBatch batch;
+    normalizeInto(inputs, batch);
+    customAssert(batch.size() == 4);
+    customAssert(batch[0] == "alpha1" && batch[1] == "" && batch[2] == "betatwo");
+    customAssert(batch[3] == "\xC3\xA9t\xC3\xA9");
+    normalizeInto(vector<string_view>{"Q"}, batch); // Reuse replaces the previous contents
+    customAssert(batch.size() == 1 && batch[0] == "q");
+}
+
+// The dispatched kernel (AVX2 where available) against the scalar one on random text that
+// mixes identifiers, separators, multi-byte characters straddling block edges and junk bytes
+void testNormalizeKernelsAgree()
+{
+    mt19937        rng(5);
+    const string   pieces[] = {"a", "Z", "7", "_", "-", " ", "\xC3\x84", "\xC3\xB7",
+                             "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xC2\xA9", "\xFF", "\xE2\x82"};
+    vector<string> inputs;
+    for (int i = 0; i < 3000; ++i) {
+        string s;
+        size_t length = rng() % 120;
+        bool   plain  = rng() % 2; // Mostly identifier characters, as in the real feed
+        while (s.size() < length) {
+            s += plain && rng() % 16 ? string(1, "abcXYZ019"[rng() % 9]) : pieces[rng() % 13];
+        }
+        inputs.push_back(s);
+    }
+    NormalizedBatch fast, scalar;
+    normalizeInto(inputs, fast);
+    normalizeInto(inputs, scalar, normalizeScalar);
+    customAssert(fast.text == scalar.text && fast.ends == scalar.ends);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        customAssert(fast[i] == processString(inputs[i]));
+    }
+}
+
+// isPalindrome against reversing the characters of the normalized text, on short strings of
+// mixed pieces so that both answers come up often
+void testPalindromeMatchesNormalized()
+{
+    mt19937      rng(9);
+    const string pieces[] = {"a", "A", "b", "_", "\xC3\x84", "\xC3\xA4", "\xC2\xA0",
+                             "\xE6\x97\xA5", "\xFF", "\xE6\x97", "\xA4"};
+    for (int i = 0; i < 20000; ++i) {
+        string s;
+        for (size_t count = rng() % 7; count > 0; --count) {
+            s += pieces[rng() % 11];
+        }
+        string         normalized = processString(s);
+        vector<string> characters;
+        auto           p = (const unsigned char*)normalized.data(), end = p + normalized.size();
+        while (p < end) {
+            size_t length = *p < 0x80 ? 1 : utf8Length(p, end);
+            characters.emplace_back((const char*)p, length);
+            p += length;
+        }
+        bool expected = equal(characters.begin(), characters.end(), characters.rbegin());
+        customAssert(isPalindrome(s) == expected);
+    }
+}
+
+// Every range, the longest substring and the distinct count against brute force
+void testPalindromeIndex()
+{
+    PalindromeIndex babad("babad"), cbbd("cbbd"), empty("");
+    customAssert(babad.longest() == make_pair(size_t(0), size_t(3)));
+    customAssert(cbbd.longest() == make_pair(size_t(1), size_t(2)));
+    customAssert(empty.longest() == make_pair(size_t(0), size_t(0)));
+    customAssert(babad.isPalindrome(1, 3) && !babad.isPalindrome(0, 3) && babad.isPalindrome(4, 4));
+    bool threw = false;
+    try {
+        babad.isPalindrome(2, 5);
+    } catch (const out_of_range&) {
+        threw = true;
+    }
+    customAssert(threw);
+
+    mt19937 rng(11);
+    for (int round = 0; round < 300; ++round) {
+        string text(rng() % 40, 'a');
+        for (char& c : text) {
+            c = "abc"[rng() % (round % 2 ? 2 : 3)];
+        }
+        PalindromeIndex      index(text);
+        set<string>          distinct;
+        pair<size_t, size_t> best = {0, 0};
+        for (size_t i = 0; i < text.size(); ++i) {
+            for (size_t j = i; j < text.size(); ++j) {
+                string piece = text.substr(i, j - i + 1);
+                bool   brute = equal(piece.begin(), piece.end(), piece.rbegin());
+                customAssert(index.isPalindrome(i, j) == brute);
+                if (brute) {
+                    distinct.insert(piece);
+                    best = piece.size() > best.second ? make_pair(i, piece.size()) : best;
+                }
+            }
+        }
+        customAssert(index.longest() == best);
+        customAssert(distinctPalindromes(text) == distinct.size());
+    }
+}
+
+void testEertreeIncremental()
+{
+    Eertree      tree;
+    vector<bool> added;
+    for (char c : string("abcabba")) {
+        added.push_back(tree.push_back(c));
+    }
+    // a, b, c, then a and b again, then bb and abba
+    customAssert((added == vector<bool>{true, true, true, false, false, true, true}));
+    customAssert(tree.distinct() == 5 && tree.longestSuffix() == 4);
+    customAssert(distinctPalindromes("") == 0 && distinctPalindromes("aaaa") == 4);
 }
 
 void runTests()
 {
     vector<string> testResults;
     testResults.push_back(runTest("testPalindrome", testPalindrome));
+    testResults.push_back(runTest("testNormalize", testNormalize));
+    testResults.push_back(runTest("testNormalizeKernelsAgree", testNormalizeKernelsAgree));
+    testResults.push_back(
+        runTest("testPalindromeMatchesNormalized", testPalindromeMatchesNormalized));
+    testResults.push_back(runTest("testPalindromeIndex", testPalindromeIndex));
+    testResults.push_back(runTest("testEertreeIncremental", testEertreeIncremental));
 
     // Print test results
     for (const auto& result : testResults) {
@@ -46,8 +624,130 @@ void runTests()
     }
 }
 
-int main()
+// Identifier-like strings: mixed case with separators, about 1 in 50 carrying a non-ASCII name
+vector<string> randomIdentifiers(size_t count, unsigned seed)
+{
+    mt19937        rng(seed);
+    const char     alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    const char     separators[] = "_-.: ";
+    vector<string> ids(count);
+    for (string& id : ids) {
+        size_t length = 8 + rng() % 40;
+        while (id.size() < length) {
+            if (rng() % 8 == 0) {
+                id += separators[rng() % 5];
+            } else if (rng() % 400 == 0) {
+                id += "\xC3\x9C";
+            } else {
+                id += alphabet[rng() % 62];
+            }
+        }
+    }
+    return ids;
+}
+
+void benchmark(size_t count)
+{
+    vector<string> ids   = randomIdentifiers(count, 1);
+    auto           start = chrono::steady_clock::now();
+    auto           since = [&start] {
+        double ms = chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e3;
+        start     = chrono::steady_clock::now();
+        return ms;
+    };
+
+    // What processString used to do: copy, remove_if, then transform
+    size_t kept = 0;
+    for (const string& id : ids) {
+        string s = id;
+        s.erase(remove_if(s.begin(), s.end(), [](char c) { return !isalnum((unsigned char)c); }),
+                s.end());
+        transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return tolower(c); });
+        kept += s.size();
+    }
+    double copying = since();
+
+    NormalizedBatch batch;
+    normalizeInto(ids, batch, normalizeScalar); // Warm the capacity, as a reused batch would be
+    since();
+    normalizeInto(ids, batch, normalizeScalar);
+    double scalar = since();
+    normalizeInto(ids, batch);
+    double fast = since();
+
+    size_t palindromes = 0;
+    for (const string& id : ids) {
+        palindromes += isPalindrome(id);
+    }
+    double checks = since();
+    cout << count << " identifiers, " << batch.text.size() << " bytes kept (copying " << kept
+         << "), " << palindromes << " palindromes" << endl;
+    cout << "ms: copy+remove_if+transform " << copying << ", batch scalar " << scalar
+         << ", batch simd " << fast << ", isPalindrome " << checks << endl;
+}
+
+// One Manacher pass over a long document against rescanning each queried range. Every other
+// 1000-byte block is mirrored, and half the queries are centred on those blocks so that they
+// are palindromes a rescan has to read in full; the rest are random ranges.
+void benchmarkIndex(size_t length, size_t queries)
 {
+    const size_t block = 1000;
+    length             = max(length, 4 * block);
+    mt19937      rng(3);
+    string       text(length, 'a');
+    for (char& c : text) {
+        c = "acgt"[rng() % 4];
+    }
+    for (size_t at = block; at + block <= length; at += 2 * block) {
+        reverse_copy(text.begin() + at, text.begin() + at + block / 2,
+                     text.begin() + at + block / 2);
+    }
+    vector<pair<size_t, size_t>> ranges(queries);
+    for (size_t q = 0; q < queries; ++q) {
+        size_t centre = (rng() % (length / (2 * block)) * 2 + 1) * block + block / 2;
+        size_t reach  = 1 + rng() % (block / 2);
+        size_t i      = q % 2 ? centre - reach : rng() % length;
+        ranges[q]     = {i, q % 2 ? centre + reach - 1 : min(length - 1, i + rng() % block)};
+    }
+    auto start = chrono::steady_clock::now();
+    auto since = [&start] {
+        double ms = chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e3;
+        start     = chrono::steady_clock::now();
+        return ms;
+    };
+
+    PalindromeIndex index(text);
+    double          build = since();
+    size_t          hits  = 0;
+    for (auto [i, j] : ranges) {
+        hits += index.isPalindrome(i, j);
+    }
+    double indexed = since();
+    size_t rescans = 0;
+    for (auto [i, j] : ranges) {
+        rescans += equal(text.begin() + i, text.begin() + j + 1, text.rbegin() + (length - 1 - j));
+    }
+    double rescanned = since();
+    size_t distinct  = distinctPalindromes(text);
+    double eertree   = since();
+    cout << length << " bytes, longest palindrome " << index.longest().second << ", " << distinct
+         << " distinct palindromes, " << hits << "/" << rescans << " of " << queries
+         << " ranges are palindromes" << endl;
+    cout << "ms: manacher build " << build << ", queries indexed " << indexed << ", rescanning "
+         << rescanned << ", eertree " << eertree << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        benchmark(argc > 2 ? stoull(argv[2]) : 2000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-index") {
+        benchmarkIndex(argc > 2 ? stoull(argv[2]) : 20000000,
+                       argc > 3 ? stoull(argv[3]) : 10000000);
+        return 0;
+    }
     runTests();
     return 0;
 }
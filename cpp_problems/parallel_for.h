@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Runs fn(0) .. fn(count - 1) on their own threads, inline when there is only one
+inline void parallelFor(std::size_t count, const std::function<void(std::size_t)>& fn)
+{
+    if (count == 1) {
+        fn(0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < count; ++i) {
+        workers.emplace_back(fn, i);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
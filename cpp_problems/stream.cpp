@@ -1,95 +1,182 @@
 #include <arpa/inet.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/net_tstamp.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
+#include "market_data.h"
+#include "order_book.h"
 #include "test_runner.h"
 using namespace std;
 
-class Buffer
+// Byte ring whose storage is mapped twice back to back, so the readable and writable regions are
+// always contiguous in memory no matter where they wrap. recv() writes straight into it and
+// messages are parsed in place without ever being copied or shifted.
+class RingBuffer
 {
    public:
-    Buffer(int bufferSize)
-        : bufferSize_(bufferSize), buffer_(new char[bufferSize]), bytesReceived_(0)
+    explicit RingBuffer(size_t minCapacity)
+        : base_(nullptr), capacity_(0), readIndex_(0), writeIndex_(0)
     {
+        map(roundCapacity(minCapacity));
     }
 
-    ~Buffer()
+    ~RingBuffer()
     {
-        delete[] buffer_;
+        unmap();
     }
 
-    void recvData(int socket)
+    RingBuffer(const RingBuffer&)            = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    char* writePtr()
     {
-        int epfd = epoll_create1(0);
-        if (epfd < 0) {
-            throw runtime_error("Failed to create epoll instance");
-        }
+        return base_ + (writeIndex_ & (capacity_ - 1));
+    }
+    size_t writable() const
+    {
+        return capacity_ - readable();
+    }
+    void commit(size_t n)
+    {
+        writeIndex_ += n;
+    }
 
-        struct epoll_event event;
-        event.events  = EPOLLIN;
-        event.data.fd = socket;
-        if (epoll_ctl(epfd, EPOLL_CTL_ADD, socket, &event) < 0) {
-            throw runtime_error("Failed to add socket to epoll");
-        }
+    const char* readPtr() const
+    {
+        return base_ + (readIndex_ & (capacity_ - 1));
+    }
+    size_t readable() const
+    {
+        return writeIndex_ - readIndex_;
+    }
+    void consume(size_t n)
+    {
+        readIndex_ += n;
+    }
 
-        while (true) {
-            struct epoll_event events[1];
-            int                num_events = epoll_wait(epfd, events, 1, 1000); // 1-second timeout
-            if (num_events < 0) {
-                throw runtime_error("Failed to wait for epoll events");
-            }
+    size_t capacity() const
+    {
+        return capacity_;
+    }
 
-            if (num_events == 0) {
-                continue; // Timeout, no events
-            }
+    // Remap with at least minCapacity bytes, keeping the unread bytes
+    void grow(size_t minCapacity)
+    {
+        if (minCapacity <= capacity_) {
+            return;
+        }
+        char*  oldBase     = base_;
+        size_t oldCapacity = capacity_;
+        size_t pending     = readable();
+        size_t offset      = readIndex_ & (oldCapacity - 1);
 
-            if (events[0].events & EPOLLIN) {
-                char temp[bufferSize_];
-                int  bytes_received = recv(socket, temp, sizeof(temp), 0);
-                if (bytes_received < 0) {
-                    throw runtime_error("Failed to receive data");
-                }
+        map(roundCapacity(minCapacity));
+        memcpy(base_, oldBase + offset, pending);
+        munmap(oldBase, 2 * oldCapacity);
+        readIndex_  = 0;
+        writeIndex_ = pending;
+    }
 
-                if (bytes_received == 0) {
-                    break; // Connection closed
-                }
+   private:
+    char*    base_;
+    size_t   capacity_;
+    uint64_t readIndex_; // Both indexes only ever increase, position is index % capacity
+    uint64_t writeIndex_;
 
-                copy(temp, temp + bytes_received, buffer_ + bytesReceived_);
-                bytesReceived_ += bytes_received;
+    // Mirroring works at page granularity and masking needs a power of two
+    static size_t roundCapacity(size_t n)
+    {
+        size_t capacity = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        while (capacity < n) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
 
-                // Process messages
-                while (bytesReceived_ >= headerSize_) {
-                    int messageSize = getMessageSize();
-                    if (bytesReceived_ >= messageSize) {
-                        processMessage();
-                        bytesReceived_ -= messageSize;
-                        memmove(buffer_, buffer_ + messageSize, bytesReceived_);
-                    } else {
-                        break;
-                    }
-                }
-            }
+    void map(size_t capacity)
+    {
+        int fd = memfd_create("ring_buffer", MFD_CLOEXEC);
+        if (fd < 0) {
+            throw runtime_error("Failed to create ring buffer memory");
+        }
+        if (ftruncate(fd, capacity) < 0) {
+            close(fd);
+            throw runtime_error("Failed to size ring buffer memory");
         }
 
-        close(epfd);
+        // Reserve twice the span, then map the same pages into both halves
+        void* region = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("Failed to reserve ring buffer address space");
+        }
+        char* base = static_cast<char*>(region);
+        int   prot = PROT_READ | PROT_WRITE;
+        if (mmap(base, capacity, prot, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+            mmap(base + capacity, capacity, prot, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(region, 2 * capacity);
+            close(fd);
+            throw runtime_error("Failed to mirror ring buffer memory");
+        }
+        close(fd); // The mappings keep the memory alive
+
+        base_     = base;
+        capacity_ = capacity;
     }
 
-   private:
-    int              bufferSize_;
-    char*            buffer_;
-    int              bytesReceived_;
-    static const int headerSize_ = 4; // Example header size
+    void unmap()
+    {
+        if (base_) {
+            munmap(base_, 2 * capacity_);
+            base_ = nullptr;
+        }
+    }
+};
 
+// Every message is framed by a 4-byte type, a 4-byte payload size and an 8-byte sequence number,
+// all in network byte order, followed by the payload
+const int frameHeaderSize = 16;
+
+class Buffer
+{
+   public:
     struct Header {
-        int messageType;
-        int payloadSize;
+        int      messageType;
+        int      payloadSize;
+        uint64_t sequence;       // Per-connection, consecutive from 1
+        int64_t  receivedNs = 0; // Kernel receive time (CLOCK_REALTIME ns) if timestamping is on
 
-        Header(int messageType, int payloadSize)
-            : messageType(messageType), payloadSize(payloadSize)
+        Header(int messageType, int payloadSize, uint64_t sequence = 0)
+            : messageType(messageType), payloadSize(payloadSize), sequence(sequence)
         {
         }
 
@@ -101,101 +188,3215 @@ class Buffer
         {
             return payloadSize;
         }
+        uint64_t getSequence() const
+        {
+            return sequence;
+        }
     };
 
+    // View over the payload bytes inside the receive buffer, valid only during the callback
     struct Payload {
-        string data;
+        string_view data;
 
-        Payload(const string& data) : data(data) {}
+        Payload(string_view data) : data(data) {}
 
-        string getData() const
+        string_view getData() const
         {
             return data;
         }
     };
 
-    int getMessageSize()
+    using MessageHandler = function<void(const Header&, const Payload&)>;
+
+    Buffer(int bufferSize, int maxMessageSize, MessageHandler handler)
+        : ring_(bufferSize), maxMessageSize_(maxMessageSize), handler_(move(handler))
+    {
+    }
+
+    // Receive and process messages from one socket until the peer closes it
+    void recvData(int socket);
+
+    // Ask the kernel for a software receive timestamp on every read from socket. Messages then
+    // carry the stamp of the read that completed them in Header::receivedNs. Data that was already
+    // queued when this is called arrives unstamped, with receivedNs left at 0.
+    void enableTimestamps(int socket)
     {
-        if (bytesReceived_ < headerSize_) {
-            throw runtime_error("Not enough data to determine message size");
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        if (setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+            throw runtime_error("Failed to enable receive timestamps");
         }
-        Header header = parseHeader(buffer_, headerSize_);
-        return headerSize_ + header.getPayloadSize();
+        timestamps_ = true;
     }
 
-    void processMessage()
+    // Read until the socket would block, as edge-triggered epoll requires, processing every
+    // complete message along the way. Returns false once the peer has closed the connection.
+    bool drain(int socket)
     {
-        try {
-            // Extract and process header
-            Header header = parseHeader(buffer_, headerSize_);
+        while (true) {
+            // Receive directly into the free region of the ring
+            ssize_t bytes_received = timestamps_
+                                         ? receiveTimestamped(socket)
+                                         : recv(socket, ring_.writePtr(), ring_.writable(), 0);
+            if (bytes_received > 0) {
+                ring_.commit(bytes_received);
+                bytesReceived_ += bytes_received;
+                processMessages();
+                continue;
+            }
+
+            if (bytes_received == 0) {
+                return false; // Connection closed
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true; // Drained
+            }
+            throw runtime_error("Failed to receive data");
+        }
+    }
+
+    // Process bytes that were received elsewhere (e.g. into an io_uring provided buffer). Complete
+    // messages are handled straight out of data when nothing is pending, only a trailing partial
+    // message is copied into the ring.
+    void feed(const char* data, size_t size)
+    {
+        if (ring_.readable() == 0) {
+            size_t needed = 0;
+            size_t used   = processFrames(data, size, needed);
+            data += used;
+            size -= used;
+            ring_.grow(needed);
+        }
+        while (size > 0) {
+            size_t n = min(size, ring_.writable());
+            memcpy(ring_.writePtr(), data, n);
+            ring_.commit(n);
+            processMessages();
+            data += n;
+            size -= n;
+        }
+    }
+
+    size_t capacity() const
+    {
+        return ring_.capacity();
+    }
+
+    uint64_t bytesReceived() const
+    {
+        return bytesReceived_;
+    }
+
+    // Called by the receive loop once it drops this parser's connection on close or failure
+    void setCloseHandler(function<void()> handler)
+    {
+        closeHandler_ = move(handler);
+    }
+    void notifyClosed()
+    {
+        if (closeHandler_) {
+            closeHandler_();
+        }
+    }
+
+   private:
+    RingBuffer       ring_;
+    size_t           maxMessageSize_;
+    MessageHandler   handler_;
+    function<void()> closeHandler_;
+    bool             timestamps_    = false;
+    int64_t          receivedNs_    = 0; // Stamp of the most recent read, 0 if it had none
+    uint64_t         bytesReceived_ = 0;
+    static const int headerSize_    = frameHeaderSize;
+
+    // recvmsg() into the ring, keeping the SCM_TIMESTAMPING software stamp if one came along
+    ssize_t receiveTimestamped(int socket)
+    {
+        iovec iov{ring_.writePtr(), ring_.writable()};
+        alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(timespec))];
+        msghdr                message{};
+        message.msg_iov        = &iov;
+        message.msg_iovlen     = 1;
+        message.msg_control    = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t bytes = recvmsg(socket, &message, 0);
+        receivedNs_   = 0;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); bytes > 0 && cmsg;
+             cmsg          = CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPING) {
+                timespec ts[3]; // Software, deprecated, hardware
+                memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+                receivedNs_ = ts[0].tv_sec * 1000000000LL + ts[0].tv_nsec;
+            }
+        }
+        return bytes;
+    }
+
+    // Hand every complete message to the handler in place, then advance past it
+    void processMessages()
+    {
+        size_t needed = 0;
+        ring_.consume(processFrames(ring_.readPtr(), ring_.readable(), needed));
+        // Make sure the rest of a partial message has room to arrive
+        ring_.grow(needed);
+    }
+
+    // Process every complete message in [data, data + size) and return the bytes consumed. Once
+    // the header of a trailing partial message is visible, needed is set to its full size.
+    size_t processFrames(const char* data, size_t size, size_t& needed)
+    {
+        size_t offset = 0;
+        while (size - offset >= headerSize_) {
+            Header header      = parseHeader(data + offset, headerSize_);
+            size_t messageSize = getMessageSize(header);
+            header.receivedNs  = receivedNs_;
+            if (size - offset < messageSize) {
+                needed = messageSize;
+                break;
+            }
+            processMessage(header, data + offset + headerSize_);
+            offset += messageSize;
+        }
+        return offset;
+    }
 
-            // Extract and process payload
-            Payload payload = parsePayload(buffer_ + headerSize_, header.getPayloadSize());
+    size_t getMessageSize(const Header& header)
+    {
+        size_t messageSize = headerSize_ + static_cast<uint32_t>(header.getPayloadSize());
+        if (messageSize > maxMessageSize_) {
+            throw runtime_error("Message exceeds maximum size");
+        }
+        return messageSize;
+    }
 
-            // Store or handle processed message
-            cout << "Received message: " << header.getMessageType() << " - " << payload.getData()
-                 << endl;
+    void processMessage(const Header& header, const char* payloadData)
+    {
+        try {
+            Payload payload = parsePayload(payloadData, header.getPayloadSize());
+            handler_(header, payload);
         } catch (const exception& e) {
             cerr << "Error processing message: " << e.what() << endl;
         }
     }
 
-    Header parseHeader(char* buffer, int headerSize)
+    Header parseHeader(const char* buffer, int headerSize)
     {
-        if (headerSize != 8) {
+        if (headerSize != 16) {
             throw runtime_error("Invalid header size");
         }
-        int messageType;
-        int payloadSize;
+        uint32_t messageType;
+        uint32_t payloadSize;
+        uint64_t sequence;
         memcpy(&messageType, buffer, 4);
         memcpy(&payloadSize, buffer + 4, 4);
-        return Header(ntohl(messageType), ntohl(payloadSize));
+        memcpy(&sequence, buffer + 8, 8);
+        return Header(ntohl(messageType), ntohl(payloadSize), be64toh(sequence));
     }
 
-    Payload parsePayload(char* buffer, int payloadSize)
+    Payload parsePayload(const char* buffer, int payloadSize)
     {
-        return Payload(string(buffer, payloadSize));
+        return Payload(string_view(buffer, static_cast<uint32_t>(payloadSize)));
     }
 };
 
-int createSocket()
+// Wire protocol payloads. Every message has a fixed layout with integers in network byte order
+// and prices in ten-thousandths. Decoding reads straight out of the receive buffer; symbols come
+// back as views into it, so nothing is allocated per message.
+const double priceScale = 10000.0;
+
+inline uint16_t readBE16(const char* p)
 {
-    // Initialize socket
-    int socket = ::socket(AF_INET, SOCK_STREAM, 0);
-    if (socket < 0) {
-        throw runtime_error("Failed to create socket");
-    }
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return be16toh(v);
+}
 
-    // Set up server address
-    sockaddr_in serverAddress;
-    serverAddress.sin_family = AF_INET;
-    serverAddress.sin_port   = htons(8080);
-    inet_pton(AF_INET, "127.0.0.1", &serverAddress.sin_addr);
+inline uint32_t readBE32(const char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return be32toh(v);
+}
 
-    // Connect to server
-    if (connect(socket, (sockaddr*)&serverAddress, sizeof(serverAddress)) < 0) {
-        throw runtime_error("Failed to connect to server");
+inline uint64_t readBE64(const char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return be64toh(v);
+}
+
+inline void writeBE32(char* p, uint32_t v)
+{
+    v = htobe32(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+inline void writeBE64(char* p, uint64_t v)
+{
+    v = htobe64(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+// Symbols travel as 8 bytes padded with NULs
+inline string_view readSymbol(const char* p)
+{
+    size_t length = 0;
+    while (length < 8 && p[length] != '\0') {
+        length++;
     }
+    return string_view(p, length);
+}
 
-    return socket;
+inline void writeSymbol(char* p, string_view symbol)
+{
+    memset(p, 0, 8);
+    memcpy(p, symbol.data(), min<size_t>(symbol.size(), 8));
 }
 
-void closeSocket(int socket)
+struct HeartbeatMsg {
+    static constexpr uint32_t type     = 0;
+    static constexpr size_t   wireSize = 0;
+
+    static HeartbeatMsg decode(const char*)
+    {
+        return {};
+    }
+    void encode(char*) const {}
+};
+
+struct AddOrderMsg {
+    static constexpr uint32_t type     = 1;
+    static constexpr size_t   wireSize = 18;
+
+    int    orderId;
+    bool   isBuy;
+    bool   fillOrKill;
+    double price;
+    int    quantity;
+
+    static AddOrderMsg decode(const char* p)
+    {
+        return {static_cast<int>(readBE32(p)),
+                p[4] != 0,
+                p[5] != 0,
+                static_cast<int64_t>(readBE64(p + 6)) / priceScale,
+                static_cast<int>(readBE32(p + 14))};
+    }
+    void encode(char* p) const
+    {
+        writeBE32(p, orderId);
+        p[4] = isBuy;
+        p[5] = fillOrKill;
+        writeBE64(p + 6, static_cast<int64_t>(llround(price * priceScale)));
+        writeBE32(p + 14, quantity);
+    }
+};
+
+struct CancelOrderMsg {
+    static constexpr uint32_t type     = 2;
+    static constexpr size_t   wireSize = 4;
+
+    int orderId;
+
+    static CancelOrderMsg decode(const char* p)
+    {
+        return {static_cast<int>(readBE32(p))};
+    }
+    void encode(char* p) const
+    {
+        writeBE32(p, orderId);
+    }
+};
+
+struct TradeMsg {
+    static constexpr uint32_t type     = 3;
+    static constexpr size_t   wireSize = 28;
+
+    string_view symbol; // Points into the receive buffer
+    double      price;
+    double      volume;
+    int         timestamp;
+
+    static TradeMsg decode(const char* p)
+    {
+        return {readSymbol(p),
+                static_cast<int64_t>(readBE64(p + 8)) / priceScale,
+                static_cast<int64_t>(readBE64(p + 16)) / priceScale,
+                static_cast<int>(readBE32(p + 24))};
+    }
+    void encode(char* p) const
+    {
+        writeSymbol(p, symbol);
+        writeBE64(p + 8, static_cast<int64_t>(llround(price * priceScale)));
+        writeBE64(p + 16, static_cast<int64_t>(llround(volume * priceScale)));
+        writeBE32(p + 24, timestamp);
+    }
+};
+
+// Routes each message to Handler::onMessage(const Msg&, string_view payload) for the registered
+// Msg with that type id, through a table of decoders built at compile time. Types with no
+// registered Msg go to Handler::onUnknown(header, payload). Holds only a pointer to the handler,
+// so it fits in Buffer::MessageHandler without allocating.
+template <typename Handler, typename... Messages>
+class Dispatcher
 {
-    if (close(socket) < 0) {
-        cerr << "Error closing socket" << endl;
+   public:
+    explicit Dispatcher(Handler& handler) : handler_(&handler) {}
+
+    void operator()(const Buffer::Header& header, const Buffer::Payload& payload) const
+    {
+        uint32_t type = static_cast<uint32_t>(header.getMessageType());
+        if (type < tableSize_) {
+            table_[type](*handler_, header, payload.getData());
+        } else {
+            handler_->onUnknown(header, payload.getData());
+        }
+    }
+
+   private:
+    using Entry = void (*)(Handler&, const Buffer::Header&, string_view);
+
+    static constexpr size_t tableSize_ = max({Messages::type...}) + 1;
+    static_assert(tableSize_ <= 256, "Message type ids must stay small to index the table");
+
+    template <typename Msg>
+    static void decodeAndHandle(Handler& handler, const Buffer::Header&, string_view payload)
+    {
+        if (payload.size() < Msg::wireSize) {
+            throw runtime_error("Truncated message payload");
+        }
+        handler.onMessage(Msg::decode(payload.data()), payload);
+    }
+
+    static void unknown(Handler& handler, const Buffer::Header& header, string_view payload)
+    {
+        handler.onUnknown(header, payload);
+    }
+
+    static constexpr array<Entry, tableSize_> makeTable()
+    {
+        array<Entry, tableSize_> table{};
+        for (auto& entry : table) {
+            entry = &unknown;
+        }
+        ((table[Messages::type] = &decodeAndHandle<Messages>), ...);
+        return table;
     }
+
+    static constexpr array<Entry, tableSize_> table_ = makeTable();
+
+    Handler* handler_;
+};
+
+inline void writeFrameHeader(char* p, uint32_t messageType, uint32_t payloadSize, uint64_t sequence)
+{
+    writeBE32(p, messageType);
+    writeBE32(p + 4, payloadSize);
+    writeBE64(p + 8, sequence);
+}
+
+// Encode one framed message with a raw payload
+string frameMessage(int messageType, string_view payload, uint64_t sequence = 0)
+{
+    string frame(frameHeaderSize + payload.size(), '\0');
+    writeFrameHeader(&frame[0], messageType, payload.size(), sequence);
+    memcpy(&frame[frameHeaderSize], payload.data(), payload.size());
+    return frame;
+}
+
+// Frame a typed message with its header
+template <typename Msg>
+string frameMessage(const Msg& msg, uint64_t sequence = 0)
+{
+    string frame(frameHeaderSize + Msg::wireSize, '\0');
+    writeFrameHeader(&frame[0], Msg::type, Msg::wireSize, sequence);
+    msg.encode(&frame[frameHeaderSize]);
+    return frame;
 }
 
-int main()
+// Interface shared by the receive backends so the caller can pick one at runtime. Each
+// connection is framed by its own Buffer; neither the socket nor the parser is owned by the loop.
+class ReceiveLoop
+{
+   public:
+    // With dropFailedConnections a connection whose parser throws is logged and removed while the
+    // others keep running; otherwise the exception propagates out of poll()/run().
+    explicit ReceiveLoop(bool dropFailedConnections)
+        : dropFailedConnections_(dropFailedConnections), running_(false)
+    {
+    }
+
+    virtual ~ReceiveLoop() = default;
+
+    virtual void   addConnection(int socket, Buffer& parser) = 0;
+    virtual void   removeConnection(int socket)              = 0;
+    virtual size_t connectionCount() const                   = 0;
+
+    // Calls onWritable once, from poll(), when the socket becomes writable or fails; this is how
+    // a non-blocking connect reports that it finished. The watch counts as a connection until it
+    // fires, and removeConnection(socket) cancels it.
+    virtual void watchWritable(int socket, function<void()> onWritable) = 0;
+
+    // Wait up to timeoutMs and service everything that is ready. Returns the number of events.
+    virtual int poll(int timeoutMs) = 0;
+
+    // Service connections until stop() is called or every connection has closed
+    void run()
+    {
+        running_ = true;
+        while (running_ && connectionCount() > 0) {
+            poll(100);
+        }
+    }
+
+    // Safe to call from another thread, run() returns within one poll timeout
+    void stop()
+    {
+        running_ = false;
+    }
+
+   protected:
+    bool dropFailedConnections_;
+
+    // Runs one step of a connection's parser, removing the connection if it closes or fails. The
+    // parser hears about the removal last, so its close handler may release it.
+    template <typename Step>
+    void service(int socket, Buffer* parser, Step step)
+    {
+        bool open;
+        try {
+            open = step();
+        } catch (const exception& e) {
+            removeConnection(socket);
+            if (!dropFailedConnections_) {
+                throw;
+            }
+            cerr << "Dropping connection " << socket << ": " << e.what() << endl;
+            parser->notifyClosed();
+            return;
+        }
+        if (!open) {
+            removeConnection(socket);
+            parser->notifyClosed();
+        }
+    }
+
+   private:
+    atomic<bool> running_;
+};
+
+// One epoll instance multiplexing any number of non-blocking feed connections. Connections are
+// edge-triggered and drained until EAGAIN.
+class EventLoop : public ReceiveLoop
 {
+   public:
+    explicit EventLoop(bool dropFailedConnections = true)
+        : ReceiveLoop(dropFailedConnections), epfd_(epoll_create1(EPOLL_CLOEXEC))
+    {
+        if (epfd_ < 0) {
+            throw runtime_error("Failed to create epoll instance");
+        }
+    }
+
+    ~EventLoop() override
+    {
+        close(epfd_);
+    }
+
+    EventLoop(const EventLoop&)            = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Switches the socket to non-blocking mode
+    void addConnection(int socket, Buffer& parser) override
+    {
+        int flags = fcntl(socket, F_GETFL, 0);
+        if (flags < 0 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+            throw runtime_error("Failed to make socket non-blocking");
+        }
+
+        if (watches_.count(socket)) {
+            throw runtime_error("Socket already registered");
+        }
+        auto inserted = connections_.try_emplace(socket, Connection{socket, &parser, nullptr});
+        if (!inserted.second) {
+            throw runtime_error("Socket already registered");
+        }
+
+        struct epoll_event event;
+        event.events   = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = &inserted.first->second;
+        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, socket, &event) < 0) {
+            connections_.erase(inserted.first);
+            throw runtime_error("Failed to add socket to epoll");
+        }
+    }
+
+    void removeConnection(int socket) override
+    {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, socket, nullptr);
+        connections_.erase(socket);
+        watches_.erase(socket);
+    }
+
+    size_t connectionCount() const override
+    {
+        return connections_.size() + watches_.size();
+    }
+
+    void watchWritable(int socket, function<void()> onWritable) override
+    {
+        if (connections_.count(socket) || watches_.count(socket)) {
+            throw runtime_error("Socket already registered");
+        }
+        auto inserted = watches_.try_emplace(socket, Connection{socket, nullptr, move(onWritable)});
+
+        struct epoll_event event;
+        event.events   = EPOLLOUT | EPOLLONESHOT;
+        event.data.ptr = &inserted.first->second;
+        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, socket, &event) < 0) {
+            watches_.erase(inserted.first);
+            throw runtime_error("Failed to add socket to epoll");
+        }
+    }
+
+    int poll(int timeoutMs) override
+    {
+        struct epoll_event events[maxEvents_];
+        int                num_events = epoll_wait(epfd_, events, maxEvents_, timeoutMs);
+        if (num_events < 0) {
+            if (errno == EINTR) {
+                return 0;
+            }
+            throw runtime_error("Failed to wait for epoll events");
+        }
+
+        for (int i = 0; i < num_events; ++i) {
+            auto* conn = static_cast<Connection*>(events[i].data.ptr);
+            if (!conn->parser) {
+                // A writable watch; unregister first so the callback may add the socket back
+                int              socket     = conn->socket;
+                function<void()> onWritable = move(conn->onWritable);
+                removeConnection(socket);
+                onWritable();
+                continue;
+            }
+            service(conn->socket, conn->parser, [conn] {
+                return conn->parser->drain(conn->socket);
+            });
+        }
+        return num_events;
+    }
+
+   private:
+    struct Connection {
+        int              socket;
+        Buffer*          parser;     // Null for a writable watch
+        function<void()> onWritable; // Set for a writable watch
+    };
+
+    static const int               maxEvents_ = 256;
+    int                            epfd_;
+    unordered_map<int, Connection> connections_;
+    unordered_map<int, Connection> watches_;
+};
+
+// io_uring receive backend. Every connection has one multishot recv outstanding that draws from a
+// shared ring of provided buffers, so a single io_uring_enter() both re-arms receives and reaps
+// completions for many messages. Construction throws when the kernel lacks provided buffer rings
+// or multishot recv (Linux 6.0+), letting makeReceiveLoop() fall back to epoll.
+class UringLoop : public ReceiveLoop
+{
+   public:
+    explicit UringLoop(bool     dropFailedConnections = true,
+                       unsigned entries               = 256,
+                       unsigned bufferCount           = 256,
+                       unsigned bufferSize            = 16 * 1024)
+        : ReceiveLoop(dropFailedConnections),
+          bufferCount_(bufferCount),
+          bufferSize_(bufferSize),
+          bufferTail_(0),
+          sqTail_(0),
+          pending_(0),
+          nextId_(1)
+    {
+        if (bufferCount == 0 || (bufferCount & (bufferCount - 1)) != 0 || bufferCount > 32768) {
+            throw runtime_error("Provided buffer count must be a power of two up to 32768");
+        }
+
+        io_uring_params params{};
+        ringFd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd_ < 0) {
+            throw runtime_error("Failed to set up io_uring");
+        }
+        try {
+            if (!(params.features & IORING_FEAT_EXT_ARG)) {
+                throw runtime_error("io_uring lacks timed waits");
+            }
+            mapRings(params);
+            registerBuffers();
+            probeMultishot();
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    ~UringLoop() override
+    {
+        release();
+    }
+
+    UringLoop(const UringLoop&)            = delete;
+    UringLoop& operator=(const UringLoop&) = delete;
+
+    void addConnection(int socket, Buffer& parser) override
+    {
+        if (socketIds_.count(socket)) {
+            throw runtime_error("Socket already registered");
+        }
+        uint64_t id = nextId_++;
+        connections_.emplace(id, Connection{socket, &parser});
+        socketIds_.emplace(socket, id);
+        armReceive(id, socket);
+    }
+
+    // Cancels the outstanding receive right away so the caller may close the socket afterwards
+    void removeConnection(int socket) override
+    {
+        auto it = socketIds_.find(socket);
+        if (it == socketIds_.end()) {
+            return;
+        }
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+        sqe->fd           = -1;
+        sqe->addr         = it->second;
+        sqe->user_data    = cancelTag_;
+        connections_.erase(it->second);
+        watches_.erase(it->second);
+        socketIds_.erase(it);
+        enter(0, 0);
+    }
+
+    size_t connectionCount() const override
+    {
+        return connections_.size() + watches_.size();
+    }
+
+    // A one-shot POLL_ADD for POLLOUT, reaped like any other completion
+    void watchWritable(int socket, function<void()> onWritable) override
+    {
+        if (socketIds_.count(socket)) {
+            throw runtime_error("Socket already registered");
+        }
+        uint64_t id = nextId_++;
+        watches_.emplace(id, Watch{socket, move(onWritable)});
+        socketIds_.emplace(socket, id);
+        io_uring_sqe* sqe  = nextSqe();
+        sqe->opcode        = IORING_OP_POLL_ADD;
+        sqe->fd            = socket;
+        sqe->poll32_events = POLLOUT;
+        sqe->user_data     = id;
+    }
+
+    int poll(int timeoutMs) override
+    {
+        enter(1, timeoutMs);
+        return reap();
+    }
+
+   private:
+    struct Connection {
+        int     socket;
+        Buffer* parser;
+    };
+
+    struct Watch {
+        int              socket;
+        function<void()> onWritable;
+    };
+
+    static const uint64_t cancelTag_  = 0; // Connection ids start at 1
+    static const uint16_t bufferGroup_ = 0;
+
+    int      ringFd_;
+    unsigned bufferCount_;
+    unsigned bufferSize_;
+    uint16_t bufferTail_;
+    unsigned sqTail_;
+    unsigned pending_; // SQEs queued but not yet submitted
+    uint64_t nextId_;
+
+    // Kernel-shared ring memory
+    void*         sqRing_     = MAP_FAILED;
+    void*         cqRing_     = MAP_FAILED;
+    size_t        sqRingSize_ = 0;
+    size_t        cqRingSize_ = 0;
+    io_uring_sqe* sqes_       = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t        sqesSize_   = 0;
+    unsigned*     sqHead_;
+    unsigned*     sqTailPtr_;
+    unsigned*     sqArray_;
+    unsigned      sqMask_;
+    unsigned      sqEntries_;
+    unsigned*     cqHead_;
+    unsigned*     cqTail_;
+    unsigned      cqMask_;
+    io_uring_cqe* cqes_;
+
+    // Provided buffers: the ring the kernel picks from and the memory behind it. The ring is
+    // addressed as a plain io_uring_buf array because io_uring_buf_ring's flexible array member
+    // is shifted by its empty placeholder struct when compiled as C++.
+    io_uring_buf* bufferRing_ = static_cast<io_uring_buf*>(MAP_FAILED);
+    char*         bufferPool_ = static_cast<char*>(MAP_FAILED);
+
+    unordered_map<uint64_t, Connection> connections_;
+    unordered_map<uint64_t, Watch>      watches_;
+    unordered_map<int, uint64_t>        socketIds_; // Connections and watches
+
+    static void* mapShared(size_t size, int fd, off_t offset)
+    {
+        int   flags = MAP_SHARED | MAP_POPULATE;
+        void* ptr   = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, fd, offset);
+        if (ptr == MAP_FAILED) {
+            throw runtime_error("Failed to map io_uring memory");
+        }
+        return ptr;
+    }
+
+    void mapRings(const io_uring_params& params)
+    {
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqRingSize_ = cqRingSize_ = max(sqRingSize_, cqRingSize_);
+        }
+        sqRing_ = mapShared(sqRingSize_, ringFd_, IORING_OFF_SQ_RING);
+        cqRing_ = (params.features & IORING_FEAT_SINGLE_MMAP)
+                      ? sqRing_
+                      : mapShared(cqRingSize_, ringFd_, IORING_OFF_CQ_RING);
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_     = static_cast<io_uring_sqe*>(mapShared(sqesSize_, ringFd_, IORING_OFF_SQES));
+
+        char* sq   = static_cast<char*>(sqRing_);
+        sqHead_    = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTailPtr_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqArray_   = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqMask_    = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries_ = params.sq_entries;
+        sqTail_    = *sqTailPtr_;
+
+        char* cq = static_cast<char*>(cqRing_);
+        cqHead_  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_  = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    void registerBuffers()
+    {
+        int anon    = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+        bufferRing_ = static_cast<io_uring_buf*>(mmap(
+            nullptr, bufferCount_ * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, anon, -1, 0));
+        bufferPool_ = static_cast<char*>(
+            mmap(nullptr, size_t(bufferCount_) * bufferSize_, PROT_READ | PROT_WRITE, anon, -1, 0));
+        if (bufferRing_ == MAP_FAILED || bufferPool_ == MAP_FAILED) {
+            throw runtime_error("Failed to allocate provided buffers");
+        }
+
+        io_uring_buf_reg reg{};
+        reg.ring_addr    = reinterpret_cast<uint64_t>(bufferRing_);
+        reg.ring_entries = bufferCount_;
+        reg.bgid         = bufferGroup_;
+        if (syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            throw runtime_error("io_uring provided buffer rings not supported");
+        }
+        for (unsigned bid = 0; bid < bufferCount_; ++bid) {
+            recycleBuffer(bid);
+        }
+        publishBuffers();
+    }
+
+    // Arm a multishot recv on a socket pair and check the kernel keeps it alive
+    void probeMultishot()
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+            throw runtime_error("Failed to create socket pair");
+        }
+        armReceive(cancelTag_, fds[0]);
+        ssize_t sent      = send(fds[1], "x", 1, 0);
+        bool    multishot = false;
+        while (sent == 1 && !multishot) {
+            enter(1, 1000);
+            unsigned head = *cqHead_;
+            unsigned tail = atomic_ref<unsigned>(*cqTail_).load(memory_order_acquire);
+            if (head == tail) {
+                break;
+            }
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = cqes_[head & cqMask_];
+                multishot               = cqe.res == 1 && (cqe.flags & IORING_CQE_F_MORE);
+                if (cqe.flags & IORING_CQE_F_BUFFER) {
+                    recycleBuffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                }
+            }
+            atomic_ref<unsigned>(*cqHead_).store(head, memory_order_release);
+            publishBuffers();
+        }
+        // Closing the ring on failure, or cancelling here on success, retires the probe request
+        if (multishot) {
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+            sqe->fd           = -1;
+            sqe->addr         = cancelTag_;
+            sqe->user_data    = cancelTag_;
+            enter(0, 0);
+        }
+        close(fds[0]);
+        close(fds[1]);
+        if (!multishot) {
+            throw runtime_error("io_uring multishot recv not supported");
+        }
+    }
+
+    void release()
+    {
+        if (bufferPool_ != MAP_FAILED) {
+            munmap(bufferPool_, size_t(bufferCount_) * bufferSize_);
+        }
+        if (bufferRing_ != MAP_FAILED) {
+            munmap(bufferRing_, bufferCount_ * sizeof(io_uring_buf));
+        }
+        if (sqes_ != MAP_FAILED) {
+            munmap(sqes_, sqesSize_);
+        }
+        if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+            munmap(cqRing_, cqRingSize_);
+        }
+        if (sqRing_ != MAP_FAILED) {
+            munmap(sqRing_, sqRingSize_);
+        }
+        close(ringFd_);
+    }
+
+    io_uring_sqe* nextSqe()
+    {
+        unsigned head = atomic_ref<unsigned>(*sqHead_).load(memory_order_acquire);
+        if (sqTail_ - head >= sqEntries_) {
+            enter(0, 0); // Queue full, hand what we have to the kernel
+        }
+        unsigned      index = sqTail_ & sqMask_;
+        io_uring_sqe* sqe   = &sqes_[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray_[index] = index;
+        sqTail_++;
+        pending_++;
+        return sqe;
+    }
+
+    void armReceive(uint64_t id, int socket)
+    {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode       = IORING_OP_RECV;
+        sqe->fd           = socket;
+        sqe->ioprio       = IORING_RECV_MULTISHOT;
+        sqe->flags        = IOSQE_BUFFER_SELECT;
+        sqe->buf_group    = bufferGroup_;
+        sqe->user_data    = id;
+    }
+
+    // Submit queued SQEs and, when minComplete > 0, wait up to timeoutMs for completions
+    void enter(unsigned minComplete, int timeoutMs)
+    {
+        atomic_ref<unsigned>(*sqTailPtr_).store(sqTail_, memory_order_release);
+
+        __kernel_timespec      ts{timeoutMs / 1000, (timeoutMs % 1000) * 1000000LL};
+        io_uring_getevents_arg arg{};
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+        unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+        long     ret   = syscall(__NR_io_uring_enter,
+                           ringFd_,
+                           pending_,
+                           minComplete,
+                           flags,
+                           minComplete > 0 ? &arg : nullptr,
+                           minComplete > 0 ? sizeof(arg) : 0);
+        if (ret < 0) {
+            if (errno == ETIME || errno == EINTR || errno == EBUSY) {
+                return;
+            }
+            throw runtime_error("Failed to enter io_uring");
+        }
+        pending_ -= static_cast<unsigned>(ret);
+    }
+
+    // Handle every completion that is ready, then hand consumed buffers back to the kernel. Each
+    // completion is retired before it is handled, so when a handler throws the ones already
+    // handled are not seen again and their buffers still go back.
+    int reap()
+    {
+        unsigned head  = *cqHead_;
+        unsigned tail  = atomic_ref<unsigned>(*cqTail_).load(memory_order_acquire);
+        int      count = 0;
+        try {
+            for (; head != tail; ++count) {
+                io_uring_cqe cqe = cqes_[head & cqMask_];
+                atomic_ref<unsigned>(*cqHead_).store(++head, memory_order_release);
+                complete(cqe);
+            }
+        } catch (...) {
+            publishBuffers();
+            throw;
+        }
+        publishBuffers();
+        return count;
+    }
+
+    void complete(const io_uring_cqe& cqe)
+    {
+        if (auto watch = watches_.find(cqe.user_data); watch != watches_.end()) {
+            // Unregister first so the callback may add the socket back as a connection
+            function<void()> onWritable = move(watch->second.onWritable);
+            socketIds_.erase(watch->second.socket);
+            watches_.erase(watch);
+            onWritable();
+            return; // Poll completions carry no buffer
+        }
+
+        // The kernel only sees the recycled buffer once reap publishes it, after the parser has
+        // read it, so recycling first keeps it even if the parser throws
+        unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            recycleBuffer(bid);
+        }
+
+        auto it = connections_.find(cqe.user_data);
+        if (it != connections_.end()) {
+            uint64_t    id     = cqe.user_data;
+            Connection& conn   = it->second;
+            int         socket = conn.socket;
+            Buffer*     parser = conn.parser;
+            if (cqe.res > 0) {
+                service(socket, parser, [&] {
+                    parser->feed(bufferPool_ + size_t(bid) * bufferSize_, cqe.res);
+                    return true;
+                });
+            } else if (cqe.res == 0) {
+                service(socket, parser, [] { return false; }); // Connection closed
+            } else if (cqe.res != -ENOBUFS) {
+                // ENOBUFS only means the provided buffers ran dry, re-arm once they're recycled
+                service(socket, parser, []() -> bool {
+                    throw runtime_error("Failed to receive data");
+                });
+            }
+            // The kernel ends a multishot receive on errors and buffer exhaustion
+            if (!(cqe.flags & IORING_CQE_F_MORE) && connections_.count(id)) {
+                armReceive(id, socket);
+            }
+        }
+    }
+
+    void recycleBuffer(unsigned bid)
+    {
+        io_uring_buf* buf = &bufferRing_[bufferTail_ & (bufferCount_ - 1)];
+        buf->addr         = reinterpret_cast<uint64_t>(bufferPool_ + size_t(bid) * bufferSize_);
+        buf->len          = bufferSize_;
+        buf->bid          = static_cast<uint16_t>(bid);
+        bufferTail_++;
+    }
+
+    void publishBuffers()
+    {
+        // The ring tail overlays the first entry's reserved field
+        atomic_ref<uint16_t>(bufferRing_[0].resv).store(bufferTail_, memory_order_release);
+    }
+};
+
+// Restrict the calling thread to one core
+void pinCurrentThread(int cpu)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+        throw runtime_error("Failed to pin thread to CPU " + to_string(cpu));
+    }
+}
+
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+struct SpinConfig {
+    int cpu        = -1; // Core to pin the receiving thread to, -1 leaves it where it is
+    int busyPollUs = 50; // SO_BUSY_POLL budget per socket, 0 leaves the socket default
+};
+
+// Low-latency backend that never sleeps: poll() spins over its non-blocking sockets until one has
+// data, so a message is picked up as soon as it lands instead of after an epoll wakeup. This
+// costs a whole core, which is why the receiving thread is pinned to one. SO_BUSY_POLL lets each
+// empty recv() also poll the NIC queue directly on drivers that support it; it needs
+// CAP_NET_ADMIN to raise above net.core.busy_read, so failing to set it is not an error.
+class SpinLoop : public ReceiveLoop
+{
+   public:
+    explicit SpinLoop(SpinConfig config = SpinConfig(), bool dropFailedConnections = true)
+        : ReceiveLoop(dropFailedConnections), config_(config)
+    {
+    }
+
+    void addConnection(int socket, Buffer& parser) override
+    {
+        if (registered(socket)) {
+            throw runtime_error("Socket already registered");
+        }
+        int flags = fcntl(socket, F_GETFL, 0);
+        if (flags < 0 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+            throw runtime_error("Failed to make socket non-blocking");
+        }
+        if (config_.busyPollUs > 0) {
+            setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &config_.busyPollUs,
+                       sizeof(config_.busyPollUs));
+        }
+        connections_.push_back({socket, &parser});
+    }
+
+    void removeConnection(int socket) override
+    {
+        for (size_t i = 0; i < connections_.size(); ++i) {
+            if (connections_[i].socket == socket) {
+                connections_[i] = connections_.back();
+                connections_.pop_back();
+                return;
+            }
+        }
+        for (size_t i = 0; i < watches_.size(); ++i) {
+            if (watches_[i].socket == socket) {
+                watches_[i] = move(watches_.back());
+                watches_.pop_back();
+                return;
+            }
+        }
+    }
+
+    size_t connectionCount() const override
+    {
+        return connections_.size() + watches_.size();
+    }
+
+    // Checked with a zero-timeout ::poll() on every pass
+    void watchWritable(int socket, function<void()> onWritable) override
+    {
+        if (registered(socket)) {
+            throw runtime_error("Socket already registered");
+        }
+        watches_.push_back({socket, move(onWritable)});
+    }
+
+    // Spins until at least one connection made progress or timeoutMs has passed. The first call
+    // from a new thread pins that thread to the configured core.
+    int poll(int timeoutMs) override
+    {
+        if (config_.cpu >= 0 && pinnedThread_ != this_thread::get_id()) {
+            pinCurrentThread(config_.cpu);
+            pinnedThread_ = this_thread::get_id();
+        }
+
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+        for (uint32_t spins = 0;; ++spins) {
+            int ready = pass();
+            if (ready > 0 || connectionCount() == 0) {
+                return ready;
+            }
+            // Reading the clock costs more than a pass over a few sockets, so only check it now
+            // and then
+            if (spins % 256 == 0 && chrono::steady_clock::now() >= deadline) {
+                return 0;
+            }
+            cpuRelax();
+        }
+    }
+
+   private:
+    struct Connection {
+        int     socket;
+        Buffer* parser;
+    };
+
+    struct Watch {
+        int              socket;
+        function<void()> onWritable;
+    };
+
+    SpinConfig         config_;
+    vector<Connection> connections_;
+    vector<Watch>      watches_;
+    thread::id         pinnedThread_;
+
+    bool registered(int socket) const
+    {
+        for (const Connection& conn : connections_) {
+            if (conn.socket == socket) {
+                return true;
+            }
+        }
+        for (const Watch& watch : watches_) {
+            if (watch.socket == socket) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Drain every connection once, then fire the watches that are writable, and return how many
+    // received data, closed or fired. Walks backwards so a removal, which swaps the last entry
+    // into the freed slot, skips nobody.
+    int pass()
+    {
+        int ready = 0;
+        for (size_t i = connections_.size(); i-- > 0;) {
+            if (i >= connections_.size()) {
+                continue; // A handler removed more than one connection
+            }
+            Connection conn   = connections_[i];
+            uint64_t   before = conn.parser->bytesReceived();
+            service(conn.socket, conn.parser, [&] {
+                bool open = conn.parser->drain(conn.socket);
+                ready += !open || conn.parser->bytesReceived() != before;
+                return open;
+            });
+        }
+        for (size_t i = watches_.size(); i-- > 0;) {
+            if (i >= watches_.size()) {
+                continue;
+            }
+            pollfd fd{watches_[i].socket, POLLOUT, 0};
+            if (::poll(&fd, 1, 0) > 0) {
+                function<void()> onWritable = move(watches_[i].onWritable);
+                watches_[i]                 = move(watches_.back());
+                watches_.pop_back();
+                onWritable();
+                ready++;
+            }
+        }
+        return ready;
+    }
+};
+
+enum class Backend { Epoll, IoUring, Spin };
+
+// io_uring when asked for and supported by the running kernel, a spinning loop with default
+// settings for Spin, epoll otherwise
+unique_ptr<ReceiveLoop> makeReceiveLoop(Backend backend, bool dropFailedConnections = true)
+{
+    if (backend == Backend::Spin) {
+        return make_unique<SpinLoop>(SpinConfig(), dropFailedConnections);
+    }
+    if (backend == Backend::IoUring) {
+        try {
+            return make_unique<UringLoop>(dropFailedConnections);
+        } catch (const exception& e) {
+            cerr << "io_uring unavailable (" << e.what() << "), falling back to epoll" << endl;
+        }
+    }
+    return make_unique<EventLoop>(dropFailedConnections);
+}
+
+void Buffer::recvData(int socket)
+{
+    EventLoop loop(false);
+    loop.addConnection(socket, *this);
+    loop.run();
+}
+
+// Dispatch table for every message the feed carries
+template <typename Handler>
+using FeedDispatcher = Dispatcher<Handler, HeartbeatMsg, AddOrderMsg, CancelOrderMsg, TradeMsg>;
+
+// Logs each decoded message, for watching a live feed by hand
+struct FeedPrinter {
+    void onMessage(const HeartbeatMsg&, string_view)
+    {
+        cout << "Heartbeat" << endl;
+    }
+    void onMessage(const AddOrderMsg& m, string_view)
+    {
+        cout << "AddOrder " << m.orderId << (m.isBuy ? " buy " : " sell ") << m.quantity << " @ "
+             << m.price << (m.fillOrKill ? " FOK" : "") << endl;
+    }
+    void onMessage(const CancelOrderMsg& m, string_view)
+    {
+        cout << "CancelOrder " << m.orderId << endl;
+    }
+    void onMessage(const TradeMsg& m, string_view)
+    {
+        cout << "Trade " << m.symbol << " " << m.volume << " @ " << m.price << " t=" << m.timestamp
+             << endl;
+    }
+    void onUnknown(const Buffer::Header& header, string_view payload)
+    {
+        cout << "Unknown message " << header.getMessageType() << " (" << payload.size()
+             << " bytes)" << endl;
+    }
+};
+
+// Bounded single-producer single-consumer ring. Each side caches the other's index so the shared
+// cache lines are only touched when the ring looks full or empty.
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+   public:
+    bool tryPush(const T& item)
+    {
+        size_t tail = tail_.load(memory_order_relaxed);
+        if (tail - cachedHead_ == Capacity) {
+            cachedHead_ = head_.load(memory_order_acquire);
+            if (tail - cachedHead_ == Capacity) {
+                return false;
+            }
+        }
+        slots_[tail & (Capacity - 1)] = item;
+        tail_.store(tail + 1, memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& item)
+    {
+        size_t head = head_.load(memory_order_relaxed);
+        if (head == cachedTail_) {
+            cachedTail_ = tail_.load(memory_order_acquire);
+            if (head == cachedTail_) {
+                return false;
+            }
+        }
+        item = slots_[head & (Capacity - 1)];
+        head_.store(head + 1, memory_order_release);
+        return true;
+    }
+
+    // Approximate when read from a third thread
+    size_t size() const
+    {
+        return tail_.load(memory_order_acquire) - head_.load(memory_order_acquire);
+    }
+
+   private:
+    alignas(64) atomic<size_t> head_{0};
+    alignas(64) size_t cachedTail_ = 0; // Consumer's view of tail_
+    alignas(64) atomic<size_t> tail_{0};
+    alignas(64) size_t cachedHead_ = 0; // Producer's view of head_
+    alignas(64) T slots_[Capacity];
+};
+
+// Counters for one pipeline stage. Written by that stage's threads, readable at any time.
+struct StageMetrics {
+    atomic<uint64_t> processed{0};
+    atomic<uint64_t> stalls{0};            // Pushes that found the queue full and had to wait
+    atomic<uint64_t> maxDepth{0};          // Queue high-water mark
+    atomic<uint64_t> latencyBuckets[40]{}; // Receive-to-apply latency, bucket i is [2^i, 2^i+1) ns
+    atomic<uint64_t> maxLatencyNs{0};
+
+    void recordDepth(uint64_t depth)
+    {
+        if (depth > maxDepth.load(memory_order_relaxed)) {
+            maxDepth.store(depth, memory_order_relaxed);
+        }
+    }
+
+    void recordLatency(uint64_t ns)
+    {
+        size_t bucket = ns == 0 ? 0 : min<size_t>(63 - __builtin_clzll(ns), 39);
+        latencyBuckets[bucket].fetch_add(1, memory_order_relaxed);
+        if (ns > maxLatencyNs.load(memory_order_relaxed)) {
+            maxLatencyNs.store(ns, memory_order_relaxed);
+        }
+        processed.fetch_add(1, memory_order_relaxed);
+    }
+
+    // Upper bound of the bucket holding the given percentile
+    uint64_t latencyPercentileNs(double percentile) const
+    {
+        uint64_t total = processed.load(memory_order_relaxed);
+        uint64_t rank  = static_cast<uint64_t>(ceil(total * percentile / 100.0));
+        uint64_t seen  = 0;
+        for (size_t i = 0; i < 40; ++i) {
+            seen += latencyBuckets[i].load(memory_order_relaxed);
+            if (seen >= max<uint64_t>(rank, 1)) {
+                return min<uint64_t>(2ULL << i, maxLatencyNs.load(memory_order_relaxed));
+            }
+        }
+        return maxLatencyNs.load(memory_order_relaxed);
+    }
+};
+
+inline int64_t nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Feed handler that fans decoded messages out to an OrderBook and a MarketData engine. The
+// receive thread (the Dispatcher handler side) copies each message into a fixed-size event and
+// pushes it onto that consumer's SPSC ring; one thread per consumer applies the events. A full
+// ring blocks the receive thread, which stops reading the socket and lets TCP push back on the
+// sender.
+class FeedPipeline
+{
+   public:
+    static const size_t queueCapacity = 1 << 16;
+
+    struct BookEvent {
+        int64_t receivedNs;
+        bool    isCancel;
+        Order   order;
+    };
+
+    struct TickEvent {
+        int64_t receivedNs;
+        char    symbol[8];
+        uint8_t symbolLength;
+        double  price;
+        double  volume;
+        int     timestamp;
+    };
+
+    FeedPipeline(OrderBook& book, MarketData& marketData)
+        : book_(book),
+          marketData_(marketData),
+          bookQueue_(make_unique<SpscRing<BookEvent, queueCapacity>>()),
+          tickQueue_(make_unique<SpscRing<TickEvent, queueCapacity>>()),
+          running_(false)
+    {
+    }
+
+    ~FeedPipeline()
+    {
+        stop();
+    }
+
+    void start()
+    {
+        running_    = true;
+        bookThread_ = thread([this] {
+            consume(*bookQueue_, bookMetrics, [this](BookEvent& e) { applyBookEvent(e); });
+        });
+        tickThread_ = thread([this] {
+            consume(*tickQueue_, tickMetrics, [this](TickEvent& e) { applyTickEvent(e); });
+        });
+    }
+
+    // Consumers finish whatever is queued before returning
+    void stop()
+    {
+        running_ = false;
+        if (bookThread_.joinable()) {
+            bookThread_.join();
+        }
+        if (tickThread_.joinable()) {
+            tickThread_.join();
+        }
+    }
+
+    size_t bookQueueDepth() const
+    {
+        return bookQueue_->size();
+    }
+    size_t tickQueueDepth() const
+    {
+        return tickQueue_->size();
+    }
+
+    // Receive side, called by the Dispatcher
+    void onMessage(const HeartbeatMsg&, string_view) {}
+
+    void onMessage(const AddOrderMsg& m, string_view)
+    {
+        Order     order(m.orderId, m.isBuy, m.price, m.quantity, m.fillOrKill);
+        BookEvent event{nowNs(), false, order};
+        push(*bookQueue_, bookMetrics, event);
+    }
+
+    void onMessage(const CancelOrderMsg& m, string_view)
+    {
+        BookEvent event{nowNs(), true, Order()};
+        event.order.orderId = m.orderId;
+        push(*bookQueue_, bookMetrics, event);
+    }
+
+    void onMessage(const TradeMsg& m, string_view)
+    {
+        TickEvent event;
+        event.receivedNs   = nowNs();
+        event.symbolLength = static_cast<uint8_t>(m.symbol.size());
+        memcpy(event.symbol, m.symbol.data(), m.symbol.size());
+        event.price     = m.price;
+        event.volume    = m.volume;
+        event.timestamp = m.timestamp;
+        push(*tickQueue_, tickMetrics, event);
+    }
+
+    void onUnknown(const Buffer::Header&, string_view) {}
+
+    StageMetrics bookMetrics;
+    StageMetrics tickMetrics;
+
+   private:
+    OrderBook&                                     book_;
+    MarketData&                                    marketData_;
+    unique_ptr<SpscRing<BookEvent, queueCapacity>> bookQueue_;
+    unique_ptr<SpscRing<TickEvent, queueCapacity>> tickQueue_;
+    atomic<bool>                                   running_;
+    thread                                         bookThread_;
+    thread                                         tickThread_;
+
+    template <typename Event>
+    void push(SpscRing<Event, queueCapacity>& queue, StageMetrics& metrics, const Event& event)
+    {
+        if (!queue.tryPush(event)) {
+            metrics.stalls.fetch_add(1, memory_order_relaxed);
+            while (!queue.tryPush(event)) {
+                this_thread::yield();
+            }
+        }
+        metrics.recordDepth(queue.size());
+    }
+
+    template <typename Event, typename Apply>
+    void consume(SpscRing<Event, queueCapacity>& queue, StageMetrics& metrics, Apply apply)
+    {
+        Event event;
+        while (true) {
+            if (queue.tryPop(event)) {
+                apply(event);
+                metrics.recordLatency(nowNs() - event.receivedNs);
+            } else if (!running_) {
+                if (queue.size() == 0) {
+                    return; // Stopped and drained
+                }
+            } else {
+                this_thread::yield();
+            }
+        }
+    }
+
+    void applyBookEvent(BookEvent& event)
+    {
+        if (event.isCancel) {
+            book_.cancelOrder(event.order.orderId);
+        } else {
+            book_.processOrder(event.order);
+        }
+    }
+
+    void applyTickEvent(const TickEvent& event)
+    {
+        string symbol(event.symbol, event.symbolLength); // Fits the small-string buffer
+        marketData_.process_tick(symbol, event.price, event.timestamp, event.volume);
+    }
+};
+
+int createSocket(int port = 8080)
+{
+    // Initialize socket
+    int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (socket < 0) {
+        throw runtime_error("Failed to create socket");
+    }
+
+    // Set up server address
+    sockaddr_in serverAddress;
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port   = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &serverAddress.sin_addr);
+
+    // Connect to server
+    if (connect(socket, (sockaddr*)&serverAddress, sizeof(serverAddress)) < 0) {
+        close(socket);
+        throw runtime_error("Failed to connect to server");
+    }
+
+    return socket;
+}
+
+// Start connecting to a loopback port without waiting. Returns -1 if the connect failed outright;
+// otherwise the socket becomes writable once the connect finishes, and connectSucceeded() tells
+// whether it worked.
+int connectNonBlocking(int port)
+{
+    int socket = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socket < 0) {
+        return -1;
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port   = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    if (connect(socket, (sockaddr*)&address, sizeof(address)) < 0 && errno != EINPROGRESS) {
+        close(socket);
+        return -1;
+    }
+    return socket;
+}
+
+bool connectSucceeded(int socket)
+{
+    int       error  = 0;
+    socklen_t length = sizeof(error);
+    return getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+}
+
+void closeSocket(int socket)
+{
+    if (close(socket) < 0) {
+        cerr << "Error closing socket" << endl;
+    }
+}
+
+// Listen on a loopback port, 0 picks an ephemeral one. port is updated to the port bound.
+int createListener(int backlog, int& port)
+{
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw runtime_error("Failed to create socket");
+    }
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port   = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    socklen_t length = sizeof(address);
+    if (::bind(listener, (sockaddr*)&address, sizeof(address)) < 0 ||
+        listen(listener, backlog) < 0 || getsockname(listener, (sockaddr*)&address, &length) < 0) {
+        close(listener);
+        throw runtime_error("Failed to listen on loopback");
+    }
+    port = ntohs(address.sin_port);
+    return listener;
+}
+
+// Loopback stand-in for an exchange retransmit service. It keeps the frames it is given by
+// sequence number and answers each request, two big-endian u64s "from" and "to", with the frames
+// in [from, to) before closing the connection. Requests reaching below the retained history get
+// the latest snapshot frame first, then the frames after it.
+class RetransmitServer
+{
+   public:
+    static const int snapshotType = 0xFFFF; // Reserved message type, sequence is the last covered
+
+    RetransmitServer() : port_(0), snapshotSequence_(0)
+    {
+        listener_ = createListener(16, port_);
+        thread_   = thread([this] { serve(); });
+    }
+
+    ~RetransmitServer()
+    {
+        shutdown(listener_, SHUT_RDWR);
+        thread_.join();
+        close(listener_);
+    }
+
+    int port() const
+    {
+        return port_;
+    }
+
+    void record(uint64_t sequence, string frame)
+    {
+        lock_guard<mutex> lock(mtx_);
+        history_[sequence] = move(frame);
+    }
+
+    // Forget frames up to and including sequence, replaced by a snapshot of the state after it
+    void snapshot(uint64_t sequence, string state)
+    {
+        lock_guard<mutex> lock(mtx_);
+        history_.erase(history_.begin(), history_.upper_bound(sequence));
+        snapshotSequence_ = sequence;
+        snapshotState_    = move(state);
+    }
+
+   private:
+    int                   listener_;
+    int                   port_;
+    thread                thread_;
+    mutex                 mtx_;
+    map<uint64_t, string> history_;
+    uint64_t              snapshotSequence_;
+    string                snapshotState_;
+
+    void serve()
+    {
+        while (true) {
+            int peer = accept(listener_, nullptr, nullptr);
+            if (peer < 0) {
+                return; // Listener shut down
+            }
+            char request[16];
+            if (recv(peer, request, sizeof(request), MSG_WAITALL) == sizeof(request)) {
+                string response = respond(readBE64(request), readBE64(request + 8));
+                send(peer, response.data(), response.size(), MSG_NOSIGNAL);
+            }
+            close(peer);
+        }
+    }
+
+    string respond(uint64_t from, uint64_t to)
+    {
+        lock_guard<mutex> lock(mtx_);
+        string            response;
+        if (from <= snapshotSequence_) {
+            response += frameMessage(snapshotType, snapshotState_, snapshotSequence_);
+            from = snapshotSequence_ + 1;
+        }
+        for (auto it = history_.lower_bound(from); it != history_.end() && it->first < to; ++it) {
+            response += it->second;
+        }
+        return response;
+    }
+};
+
+// Sequencing in front of one feed connection. Messages are passed downstream strictly in sequence
+// order: duplicates are dropped and early arrivals wait in a bounded reorder window. A gap that is
+// still open after gapTolerance later messages, or that outgrows the window, is recovered by
+// asking the retransmit server for the missing range. The replay connection is opened without
+// blocking, the request goes out once the loop reports it writable, and the replay arrives on that
+// connection in the same receive loop, so the loop thread never blocks on it and every other
+// connection keeps flowing. A recovery that cannot connect or send counts as failed. A snapshot in
+// the replay goes to the snapshot handler and moves the feed past it.
+class SequencedFeed
+{
+   public:
+    using SnapshotHandler = function<void(uint64_t sequence, string_view state)>;
+
+    struct Metrics {
+        uint64_t delivered  = 0;
+        uint64_t duplicates = 0;
+        uint64_t reordered  = 0; // Delivered from the reorder window
+        uint64_t overflowed = 0; // Too far ahead for the window, left to recovery
+        uint64_t recoveries = 0;
+        uint64_t failed     = 0; // Recoveries that failed or made no progress
+        uint64_t snapshots  = 0;
+    };
+
+    SequencedFeed(ReceiveLoop&           loop,
+                  int                    retransmitPort,
+                  Buffer::MessageHandler downstream,
+                  SnapshotHandler        onSnapshot,
+                  size_t                 reorderWindow = 1024,
+                  size_t                 gapTolerance  = 64,
+                  int                    bufferSize    = 64 * 1024)
+        : loop_(loop),
+          retransmitPort_(retransmitPort),
+          downstream_(move(downstream)),
+          onSnapshot_(move(onSnapshot)),
+          window_(reorderWindow),
+          gapTolerance_(gapTolerance),
+          recoverAt_(gapTolerance),
+          bufferSize_(bufferSize),
+          live_(bufferSize,
+                1 << 20,
+                [this](const Buffer::Header& h, const Buffer::Payload& p) { onMessage(h, p); }),
+          recoverySocket_(-1)
+    {
+    }
+
+    ~SequencedFeed()
+    {
+        endRecovery();
+    }
+
+    // Register this with the receive loop for the live connection
+    Buffer& liveParser()
+    {
+        return live_;
+    }
+
+    uint64_t nextSequence() const
+    {
+        return expected_;
+    }
+    bool recovering() const
+    {
+        return recoverySocket_ >= 0;
+    }
+    const Metrics& metrics() const
+    {
+        return metrics_;
+    }
+
+   private:
+    struct Slot {
+        bool     present = false;
+        uint64_t sequence;
+        int      messageType;
+        string   payload; // Capacity is reused, so steady state buffering doesn't allocate
+    };
+
+    ReceiveLoop&           loop_;
+    int                    retransmitPort_;
+    Buffer::MessageHandler downstream_;
+    SnapshotHandler        onSnapshot_;
+    vector<Slot>           window_;
+    size_t                 gapTolerance_;
+    size_t                 recoverAt_; // Messages held past a gap before recovering
+    int                    bufferSize_;
+    Buffer                 live_;
+    unique_ptr<Buffer>     recovery_;
+    unique_ptr<Buffer>     retired_; // Previous replay parser, may still be on the call stack
+    int                    recoverySocket_;
+    uint64_t               expected_       = 1;
+    uint64_t               highestSeen_    = 0;
+    uint64_t               recoveryFrom_   = 0;
+    size_t                 buffered_       = 0;
+    size_t                 overflowed_     = 0; // Dropped past the window since the last request
+    Metrics                metrics_;
+
+    // Live and replayed messages go through the same ordering
+    void onMessage(const Buffer::Header& header, const Buffer::Payload& payload)
+    {
+        uint64_t sequence = header.getSequence();
+        highestSeen_      = max(highestSeen_, sequence);
+        if (sequence < expected_) {
+            metrics_.duplicates++;
+            return;
+        }
+        if (sequence == expected_) {
+            deliver(header, payload.getData());
+            drainWindow();
+            return;
+        }
+
+        if (sequence - expected_ >= window_.size()) {
+            metrics_.overflowed++;
+            overflowed_++;
+            maybeRecover();
+            return;
+        }
+        Slot& slot = window_[sequence % window_.size()];
+        if (slot.present) {
+            metrics_.duplicates++;
+            return;
+        }
+        slot.present     = true;
+        slot.sequence    = sequence;
+        slot.messageType = header.getMessageType();
+        slot.payload.assign(payload.getData());
+        buffered_++;
+        maybeRecover();
+    }
+
+    void maybeRecover()
+    {
+        if (!recovering() && buffered_ + overflowed_ >= recoverAt_) {
+            startRecovery();
+        }
+    }
+
+    void onReplayMessage(const Buffer::Header& header, const Buffer::Payload& payload)
+    {
+        if (header.getMessageType() != RetransmitServer::snapshotType) {
+            onMessage(header, payload);
+            return;
+        }
+        uint64_t sequence = header.getSequence();
+        if (sequence < expected_) {
+            return; // Already past it
+        }
+        metrics_.snapshots++;
+        onSnapshot_(sequence, payload.getData());
+        // Everything the snapshot covers is now redundant
+        for (auto& slot : window_) {
+            if (slot.present && slot.sequence <= sequence) {
+                slot.present = false;
+                buffered_--;
+            }
+        }
+        expected_ = sequence + 1;
+        drainWindow();
+    }
+
+    void deliver(const Buffer::Header& header, string_view payload)
+    {
+        downstream_(header, Buffer::Payload(payload));
+        expected_++;
+        metrics_.delivered++;
+    }
+
+    void drainWindow()
+    {
+        while (buffered_ > 0) {
+            Slot& slot = window_[expected_ % window_.size()];
+            if (!slot.present || slot.sequence != expected_) {
+                break;
+            }
+            slot.present = false;
+            buffered_--;
+            metrics_.reordered++;
+            Buffer::Header header(slot.messageType, slot.payload.size(), slot.sequence);
+            deliver(header, slot.payload);
+        }
+    }
+
+    // Ask for everything from the first missing message up to the first one we hold, or up to
+    // the newest seen if messages were dropped for lack of window space
+    void startRecovery()
+    {
+        uint64_t to = highestSeen_ + 1;
+        if (overflowed_ == 0) {
+            for (uint64_t s = expected_ + 1; s <= highestSeen_; ++s) {
+                const Slot& slot = window_[s % window_.size()];
+                if (slot.present && slot.sequence == s) {
+                    to = s;
+                    break;
+                }
+            }
+        }
+        overflowed_   = 0;
+        recoveryFrom_ = expected_;
+        metrics_.recoveries++;
+
+        recoverySocket_ = connectNonBlocking(retransmitPort_);
+        if (recoverySocket_ < 0) {
+            recoveryFailed();
+            return;
+        }
+        try {
+            loop_.watchWritable(recoverySocket_, [this, to] { sendRecoveryRequest(to); });
+        } catch (const exception&) {
+            recoveryFailed();
+        }
+    }
+
+    // The connect finished; the request is 16 bytes on a fresh socket, so it never blocks
+    void sendRecoveryRequest(uint64_t to)
+    {
+        char request[16];
+        writeBE64(request, recoveryFrom_);
+        writeBE64(request + 8, to);
+        if (!connectSucceeded(recoverySocket_) ||
+            send(recoverySocket_, request, sizeof(request), MSG_NOSIGNAL | MSG_DONTWAIT) !=
+                sizeof(request)) {
+            recoveryFailed();
+            return;
+        }
+
+        retired_  = move(recovery_);
+        recovery_ = make_unique<Buffer>(
+            bufferSize_, 1 << 20, [this](const Buffer::Header& h, const Buffer::Payload& p) {
+                onReplayMessage(h, p);
+            });
+        recovery_->setCloseHandler([this] { onRecoveryClosed(); });
+        try {
+            loop_.addConnection(recoverySocket_, *recovery_);
+        } catch (const exception&) {
+            recoveryFailed();
+        }
+    }
+
+    void onRecoveryClosed()
+    {
+        if (expected_ == recoveryFrom_) {
+            recoveryFailed(); // The server had nothing for us
+            return;
+        }
+        closeSocket(recoverySocket_);
+        recoverySocket_ = -1;
+        recoverAt_      = gapTolerance_;
+        maybeRecover();
+    }
+
+    // Close the replay connection, if any, and wait for more to pile up before asking again
+    void recoveryFailed()
+    {
+        if (recoverySocket_ >= 0) {
+            closeSocket(recoverySocket_);
+            recoverySocket_ = -1;
+        }
+        metrics_.failed++;
+        recoverAt_ = buffered_ + overflowed_ + gapTolerance_;
+    }
+
+    void endRecovery()
+    {
+        if (recovering()) {
+            loop_.removeConnection(recoverySocket_);
+            closeSocket(recoverySocket_);
+            recoverySocket_ = -1;
+        }
+    }
+};
+
+// Shape of the traffic FeedSimulator produces
+struct SimulatorConfig {
+    uint64_t messages          = 100000;
+    double   messagesPerSecond = 0;  // 0 sends as fast as the socket allows
+    size_t   burstSize         = 64; // Messages written back to back between pacing pauses
+    size_t   minPayload        = 0;  // Payloads are padded up to a random size in this range,
+    size_t   maxPayload        = 64; // never below the message's own wire size
+    size_t   maxChunk          = 0;  // When set, writes are cut at random points no larger than
+                                     // this so frames straddle the reader's recv() calls
+    unsigned seed              = 1;
+};
+
+// Deterministic stream of sequenced add order, cancel and trade frames for a given config
+class FeedGenerator
+{
+   public:
+    explicit FeedGenerator(const SimulatorConfig& config)
+        : config_(config), rng_(config.seed), sequence_(0)
+    {
+    }
+
+    bool done() const
+    {
+        return sequence_ >= config_.messages;
+    }
+
+    // Append the next frame to out. Bids sit below 100 and offers above, so nothing crosses.
+    void next(string& out)
+    {
+        uint64_t seq = ++sequence_;
+        int      id  = static_cast<int>(seq);
+        switch (seq % 4) {
+            case 0:
+                append(out, AddOrderMsg{id, true, false, 99.0 - (seq % 50) * 0.01, 10}, seq);
+                break;
+            case 1:
+                append(out, AddOrderMsg{id, false, false, 101.0 + (seq % 50) * 0.01, 10}, seq);
+                break;
+            case 2:
+                append(out, CancelOrderMsg{id - 1}, seq); // Always the offer just added
+                break;
+            default:
+                append(out, TradeMsg{symbols_[seq % 4], 100.0, 1, static_cast<int>(seq)}, seq);
+        }
+    }
+
+    // Everything the config describes, as one byte string
+    string all()
+    {
+        string out;
+        while (!done()) {
+            next(out);
+        }
+        return out;
+    }
+
+   private:
+    static constexpr string_view symbols_[4] = {"AAPL", "MSFT", "GOOG", "AMZN"};
+
+    SimulatorConfig config_;
+    mt19937         rng_;
+    uint64_t        sequence_;
+
+    template <typename Msg>
+    void append(string& out, const Msg& msg, uint64_t seq)
+    {
+        size_t low  = max(config_.minPayload, Msg::wireSize);
+        size_t high = max(config_.maxPayload, low);
+        size_t size = uniform_int_distribution<size_t>(low, high)(rng_);
+
+        size_t start = out.size();
+        out.resize(start + frameHeaderSize + size);
+        writeFrameHeader(&out[start], Msg::type, size, seq);
+        msg.encode(&out[start + frameHeaderSize]);
+    }
+};
+
+// Loopback feed server for exercising and measuring the reader without an exchange. Accepts one
+// client and streams the configured traffic, honouring rate, burst and partial-frame settings.
+class FeedSimulator
+{
+   public:
+    explicit FeedSimulator(SimulatorConfig config, int port = 0)
+        : config_(config), port_(port), bytesSent_(0)
+    {
+        listener_ = createListener(1, port_);
+    }
+
+    ~FeedSimulator()
+    {
+        // Destructors must not throw, so an error nobody joined for is only reported
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (error_) {
+            try {
+                rethrow_exception(error_);
+            } catch (const exception& e) {
+                cerr << "Feed simulator: " << e.what() << endl;
+            }
+        }
+        close(listener_);
+    }
+
+    int port() const
+    {
+        return port_;
+    }
+    uint64_t bytesSent() const
+    {
+        return bytesSent_;
+    }
+
+    // Errors on the serving thread are kept for join, since letting them escape would terminate
+    void start()
+    {
+        thread_ = thread([this] {
+            try {
+                serve();
+            } catch (...) {
+                error_ = current_exception();
+            }
+        });
+    }
+
+    // Wait for the serving thread and rethrow anything it failed with
+    void join()
+    {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (error_) {
+            exception_ptr error = error_;
+            error_              = nullptr;
+            rethrow_exception(error);
+        }
+    }
+
+    // Accept one client and stream everything to it, then close
+    void serve()
+    {
+        int peer = accept(listener_, nullptr, nullptr);
+        if (peer < 0) {
+            throw runtime_error("Failed to accept feed client");
+        }
+        int one = 1;
+        setsockopt(peer, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        FeedGenerator generator(config_);
+        mt19937       rng(config_.seed + 1);
+        string        burst;
+        auto          start = chrono::steady_clock::now();
+        uint64_t      sent  = 0;
+        while (!generator.done()) {
+            burst.clear();
+            for (size_t i = 0; i < config_.burstSize && !generator.done(); ++i, ++sent) {
+                generator.next(burst);
+            }
+            try {
+                sendChunked(peer, burst, rng);
+            } catch (...) {
+                close(peer);
+                throw;
+            }
+
+            if (config_.messagesPerSecond > 0) {
+                auto due = start + chrono::duration<double>(sent / config_.messagesPerSecond);
+                this_thread::sleep_until(due);
+            }
+        }
+        close(peer);
+    }
+
+   private:
+    SimulatorConfig  config_;
+    int              port_;
+    int              listener_;
+    atomic<uint64_t> bytesSent_;
+    thread           thread_;
+    exception_ptr    error_;
+
+    void sendChunked(int peer, const string& data, mt19937& rng)
+    {
+        for (size_t off = 0; off < data.size();) {
+            size_t chunk = data.size() - off;
+            if (config_.maxChunk > 0) {
+                chunk = min(chunk, uniform_int_distribution<size_t>(1, config_.maxChunk)(rng));
+            }
+            ssize_t n = send(peer, data.data() + off, chunk, MSG_NOSIGNAL);
+            if (n <= 0) {
+                throw runtime_error("Failed to send feed data");
+            }
+            off += n;
+            bytesSent_ += n;
+        }
+    }
+};
+
+// Counts what the dispatcher decodes, checking sequence numbers arrive in order
+struct CountingHandler {
+    uint64_t messages     = 0;
+    uint64_t unknown      = 0;
+    uint64_t outOfOrder   = 0;
+    uint64_t lastSequence = 0;
+
+    template <typename Msg>
+    void onMessage(const Msg&, string_view)
+    {
+        messages++;
+    }
+    void onUnknown(const Buffer::Header&, string_view)
+    {
+        unknown++;
+    }
+    void onSequence(uint64_t sequence)
+    {
+        if (sequence != lastSequence + 1) {
+            outOfOrder++;
+        }
+        lastSequence = sequence;
+    }
+};
+
+// Dispatcher plus a sequence check, as a Buffer handler
+Buffer::MessageHandler countingHandler(CountingHandler& counter)
+{
+    FeedDispatcher<CountingHandler> dispatch(counter);
+    return [&counter, dispatch](const Buffer::Header& h, const Buffer::Payload& p) {
+        counter.onSequence(h.getSequence());
+        dispatch(h, p);
+    };
+}
+
+// Feed the given chunks through a socket pair, one send per chunk, and collect what Buffer parses
+vector<pair<int, string>> receiveChunks(int                   bufferSize,
+                                        int                   maxMessageSize,
+                                        const vector<string>& chunks)
+{
+    vector<pair<int, string>> received;
+    Buffer::MessageHandler    collect = [&](const Buffer::Header& h, const Buffer::Payload& p) {
+        received.emplace_back(h.getMessageType(), string(p.getData()));
+    };
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        throw runtime_error("Failed to create socket pair");
+    }
+    Buffer buffer(bufferSize, maxMessageSize, collect);
+    for (const auto& chunk : chunks) {
+        if (send(fds[1], chunk.data(), chunk.size(), 0) != static_cast<ssize_t>(chunk.size())) {
+            throw runtime_error("Failed to send test data");
+        }
+    }
+    close(fds[1]);
+    try {
+        buffer.recvData(fds[0]);
+    } catch (...) {
+        close(fds[0]);
+        throw;
+    }
+    close(fds[0]);
+    return received;
+}
+
+void testRingBufferMirrorsAcrossWrap()
+{
+    RingBuffer ring(1);
+    size_t     capacity = ring.capacity();
+    customAssert(capacity >= 4096 && (capacity & (capacity - 1)) == 0);
+
+    // Leave the indexes just short of the end so the next write wraps
+    ring.commit(capacity - 3);
+    ring.consume(capacity - 3);
+    memcpy(ring.writePtr(), "abcdef", 6);
+    ring.commit(6);
+    customAssert(string_view(ring.readPtr(), ring.readable()) == "abcdef");
+    ring.consume(6);
+    customAssert(ring.readable() == 0);
+}
+
+void testRingBufferGrowKeepsPending()
+{
+    RingBuffer ring(4096);
+    ring.commit(4000);
+    ring.consume(4000);
+    memcpy(ring.writePtr(), "hello", 5);
+    ring.commit(5);
+    ring.grow(3 * 4096);
+    customAssert(ring.capacity() == 4 * 4096);
+    customAssert(string_view(ring.readPtr(), ring.readable()) == "hello");
+}
+
+void testFramingSplitAcrossReads()
+{
+    string a = frameMessage(1, "first");
+    string b = frameMessage(2, "second");
+    string stream = a + b;
+    // Split inside a header and inside a payload
+    vector<string> chunks = {stream.substr(0, 3), stream.substr(3, 15), stream.substr(18)};
+
+    auto received = receiveChunks(4096, 1 << 20, chunks);
+    customAssert(received.size() == 2);
+    customAssert(received[0] == make_pair(1, string("first")));
+    customAssert(received[1] == make_pair(2, string("second")));
+}
+
+void testLargeMessageGrowsBuffer()
+{
+    string payload(20000, 'x');
+    auto   received = receiveChunks(4096, 1 << 20, {frameMessage(7, payload)});
+    customAssert(received.size() == 1);
+    customAssert(received[0].second == payload);
+}
+
+void testOversizedMessageRejected()
+{
+    string payload(5000, 'x');
+    bool   threw = false;
+    try {
+        receiveChunks(4096, 4096, {frameMessage(7, payload)});
+    } catch (const runtime_error&) {
+        threw = true;
+    }
+    customAssert(threw);
+}
+
+void testEventLoopMultiplexesConnections()
+{
+    const int                  connections = 8;
+    vector<int>                counts(connections, 0);
+    vector<unique_ptr<Buffer>> parsers;
+    vector<int>                readers;
+    EventLoop                  loop;
+
+    for (int i = 0; i < connections; ++i) {
+        int fds[2];
+        customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        parsers.push_back(make_unique<Buffer>(
+            4096, 1 << 20, [&counts, i](const Buffer::Header& h, const Buffer::Payload&) {
+                customAssert(h.getMessageType() == i);
+                counts[i]++;
+            }));
+        loop.addConnection(fds[0], *parsers.back());
+        readers.push_back(fds[0]);
+
+        string frames;
+        for (int m = 0; m <= i; ++m) {
+            frames += frameMessage(i, "payload");
+        }
+        customAssert(send(fds[1], frames.data(), frames.size(), 0) == (ssize_t)frames.size());
+        close(fds[1]);
+    }
+
+    loop.run();
+    customAssert(loop.connectionCount() == 0);
+    for (int i = 0; i < connections; ++i) {
+        customAssert(counts[i] == i + 1);
+        close(readers[i]);
+    }
+}
+
+void testEventLoopDropsFailedConnection()
+{
+    int    good = 0;
+    Buffer goodParser(4096, 4096, [&](const Buffer::Header&, const Buffer::Payload&) { good++; });
+    Buffer badParser(4096, 4096, [](const Buffer::Header&, const Buffer::Payload&) {});
+
+    int goodFds[2], badFds[2];
+    customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, goodFds) == 0);
+    customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, badFds) == 0);
+    string oversized = frameMessage(1, string(5000, 'x'));
+    string frame     = frameMessage(1, "ok");
+    send(badFds[1], oversized.data(), oversized.size(), 0);
+    send(goodFds[1], frame.data(), frame.size(), 0);
+
+    EventLoop loop;
+    loop.addConnection(badFds[0], badParser);
+    loop.addConnection(goodFds[0], goodParser);
+    loop.poll(1000);
+    customAssert(loop.connectionCount() == 1);
+    customAssert(good == 1);
+
+    for (int fd : {goodFds[0], goodFds[1], badFds[0], badFds[1]}) {
+        close(fd);
+    }
+}
+
+// Run frames through a receive loop over socket pairs, returning the messages per connection
+vector<int> receiveOnLoop(ReceiveLoop& loop, int connections, int messagesPerConnection)
+{
+    vector<int>                counts(connections, 0);
+    vector<unique_ptr<Buffer>> parsers;
+    vector<int>                readers;
+    for (int i = 0; i < connections; ++i) {
+        int fds[2];
+        customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        parsers.push_back(make_unique<Buffer>(
+            4096, 1 << 20, [&counts, i](const Buffer::Header& h, const Buffer::Payload& p) {
+                customAssert(h.getMessageType() == i && p.getData() == "payload");
+                counts[i]++;
+            }));
+        loop.addConnection(fds[0], *parsers.back());
+        readers.push_back(fds[0]);
+
+        string frames;
+        for (int m = 0; m < messagesPerConnection; ++m) {
+            frames += frameMessage(i, "payload");
+        }
+        customAssert(send(fds[1], frames.data(), frames.size(), 0) == (ssize_t)frames.size());
+        close(fds[1]);
+    }
+
+    loop.run();
+    for (int reader : readers) {
+        close(reader);
+    }
+    return counts;
+}
+
+void testUringLoopReceivesFrames()
+{
+    unique_ptr<UringLoop> loop;
+    try {
+        // Tiny provided buffers so frames straddle buffers and the pool runs dry
+        loop = make_unique<UringLoop>(true, 64, 4, 100);
+    } catch (const runtime_error& e) {
+        cout << "io_uring unavailable, skipping: " << e.what() << endl;
+        return;
+    }
+    auto counts = receiveOnLoop(*loop, 4, 50);
+    customAssert(loop->connectionCount() == 0);
+    for (int count : counts) {
+        customAssert(count == 50);
+    }
+}
+
+// Without dropping, a failing parser throws out of poll(); the completions handled before it
+// must not be handled again, and the buffers must keep circulating
+void testUringLoopFailureDoesNotReplay()
+{
+    unique_ptr<UringLoop> loop;
+    try {
+        loop = make_unique<UringLoop>(false, 64, 2, 64);
+    } catch (const runtime_error& e) {
+        cout << "io_uring unavailable, skipping: " << e.what() << endl;
+        return;
+    }
+    int    good = 0;
+    Buffer goodParser(4096, 4096, [&](const Buffer::Header&, const Buffer::Payload&) { good++; });
+    Buffer badParser(4096, 4096, [](const Buffer::Header&, const Buffer::Payload&) {});
+    int    goodFds[2], badFds[2];
+    customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, goodFds) == 0);
+    customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, badFds) == 0);
+    string frame     = frameMessage(1, "ok");
+    string oversized = frameMessage(1, string(5000, 'x'));
+    send(goodFds[1], frame.data(), frame.size(), 0);
+    send(badFds[1], oversized.data(), 64, 0); // The header alone is enough to fail
+
+    // Both receives complete on submission, the good one first
+    loop->addConnection(goodFds[0], goodParser);
+    loop->addConnection(badFds[0], badParser);
+    bool threw = false;
+    try {
+        for (int i = 0; i < 10 && !threw; ++i) {
+            loop->poll(100);
+        }
+    } catch (const runtime_error&) {
+        threw = true;
+    }
+    customAssert(threw && loop->connectionCount() == 1);
+
+    for (int i = 0; i < 20; ++i) {
+        send(goodFds[1], frame.data(), frame.size(), 0);
+    }
+    for (int i = 0; i < 100 && good < 21; ++i) {
+        loop->poll(10);
+    }
+    customAssert(good == 21);
+    for (int fd : {goodFds[0], goodFds[1], badFds[0], badFds[1]}) {
+        close(fd);
+    }
+}
+
+void testReceiveLoopFallback()
+{
+    // Whichever backend is picked must deliver the same messages
+    for (Backend backend : {Backend::Epoll, Backend::IoUring}) {
+        auto loop   = makeReceiveLoop(backend);
+        auto counts = receiveOnLoop(*loop, 3, 10);
+        for (int count : counts) {
+            customAssert(count == 10);
+        }
+    }
+}
+
+struct RecordingHandler {
+    vector<AddOrderMsg> adds;
+    vector<int>         cancels;
+    vector<string>      trades;
+    int                 heartbeats = 0;
+    int                 unknown    = 0;
+
+    void onMessage(const HeartbeatMsg&, string_view)
+    {
+        heartbeats++;
+    }
+    void onMessage(const AddOrderMsg& m, string_view payload)
+    {
+        customAssert(payload.size() == AddOrderMsg::wireSize);
+        adds.push_back(m);
+    }
+    void onMessage(const CancelOrderMsg& m, string_view)
+    {
+        cancels.push_back(m.orderId);
+    }
+    void onMessage(const TradeMsg& m, string_view payload)
+    {
+        // The symbol is a view into the payload, not a copy
+        customAssert(m.symbol.data() == payload.data());
+        trades.push_back(string(m.symbol) + " " + to_string(m.price) + " " + to_string(m.volume) +
+                         " " + to_string(m.timestamp));
+    }
+    void onUnknown(const Buffer::Header&, string_view)
+    {
+        unknown++;
+    }
+};
+
+void testDispatcherDecodesTypedMessages()
+{
+    RecordingHandler handler;
+    Buffer           buffer(4096, 1 << 20, FeedDispatcher<RecordingHandler>(handler));
+
+    string stream = frameMessage(HeartbeatMsg{}) +
+                    frameMessage(AddOrderMsg{42, true, false, 101.25, 7}) +
+                    frameMessage(CancelOrderMsg{42}) +
+                    frameMessage(TradeMsg{"AAPL", 189.5, 300, 1700});
+    buffer.feed(stream.data(), stream.size());
+
+    customAssert(handler.heartbeats == 1);
+    customAssert(handler.adds.size() == 1);
+    customAssert(handler.adds[0].orderId == 42 && handler.adds[0].isBuy);
+    customAssert(!handler.adds[0].fillOrKill);
+    customAssert(handler.adds[0].price == 101.25 && handler.adds[0].quantity == 7);
+    customAssert(handler.cancels == vector<int>{42});
+    customAssert(handler.trades == vector<string>{"AAPL 189.500000 300.000000 1700"});
+    customAssert(handler.unknown == 0);
+}
+
+void testDispatcherUnknownAndTruncated()
+{
+    RecordingHandler handler;
+    Buffer           buffer(4096, 1 << 20, FeedDispatcher<RecordingHandler>(handler));
+
+    // Unknown types inside and beyond the table, then a trade too short to decode
+    string stream = frameMessage(9, "abc") + frameMessage(1000, "") +
+                    frameMessage(TradeMsg::type, "x") + frameMessage(CancelOrderMsg{5});
+    buffer.feed(stream.data(), stream.size());
+
+    customAssert(handler.unknown == 2);
+    customAssert(handler.trades.empty());
+    customAssert(handler.cancels == vector<int>{5});
+}
+
+void testSpscRingWrapsAndBounds()
+{
+    auto ring = make_unique<SpscRing<int, 4>>();
+    int  value;
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 4; ++i) {
+            customAssert(ring->tryPush(round * 10 + i));
+        }
+        customAssert(!ring->tryPush(99));
+        customAssert(ring->size() == 4);
+        for (int i = 0; i < 4; ++i) {
+            customAssert(ring->tryPop(value) && value == round * 10 + i);
+        }
+        customAssert(!ring->tryPop(value));
+    }
+}
+
+void testPipelineAppliesToBookAndStats()
+{
+    OrderBook  book;
+    MarketData marketData;
+    book.verbose = false;
+
+    FeedPipeline pipeline(book, marketData);
+    Buffer       buffer(4096, 1 << 20, FeedDispatcher<FeedPipeline>(pipeline));
+    pipeline.start();
+
+    string stream = frameMessage(AddOrderMsg{1, true, false, 99.5, 10}) +
+                    frameMessage(AddOrderMsg{2, false, false, 100.5, 5}) +
+                    frameMessage(AddOrderMsg{3, true, false, 99.0, 4}) +
+                    frameMessage(CancelOrderMsg{3}) + frameMessage(TradeMsg{"AAPL", 100.0, 2, 1}) +
+                    frameMessage(TradeMsg{"AAPL", 101.0, 2, 2});
+    buffer.feed(stream.data(), stream.size());
+    pipeline.stop();
+
+    customAssert(book.orderLookup.size() == 2);
+    customAssert(book.buyOrders.size() == 1 && book.buyOrders.begin()->first == 99.5);
+    customAssert(book.sellOrders.size() == 1);
+    customAssert(marketData.get_vwap("AAPL") == 100.5);
+    customAssert(pipeline.bookMetrics.processed == 4);
+    customAssert(pipeline.tickMetrics.processed == 2);
+    customAssert(pipeline.bookQueueDepth() == 0 && pipeline.tickQueueDepth() == 0);
+}
+
+// Frames with the given sequence numbers, each payload naming its sequence
+string sequencedFrames(const vector<uint64_t>& sequences)
+{
+    string frames;
+    for (uint64_t seq : sequences) {
+        frames += frameMessage(1, "m" + to_string(seq), seq);
+    }
+    return frames;
+}
+
+vector<uint64_t> sequenceRange(uint64_t first, uint64_t last)
+{
+    vector<uint64_t> sequences;
+    for (uint64_t seq = first; seq <= last; ++seq) {
+        sequences.push_back(seq);
+    }
+    return sequences;
+}
+
+void testSequencedFeedReordersAndDropsDuplicates()
+{
+    RetransmitServer server;
+    EventLoop        loop;
+    vector<uint64_t> seen;
+    SequencedFeed    feed(
+        loop,
+        server.port(),
+        [&](const Buffer::Header& h, const Buffer::Payload& p) {
+            customAssert(p.getData() == "m" + to_string(h.getSequence()));
+            seen.push_back(h.getSequence());
+        },
+        nullptr,
+        16,
+        8);
+
+    string frames = sequencedFrames({1, 3, 2, 2, 4, 1});
+    feed.liveParser().feed(frames.data(), frames.size());
+
+    customAssert(seen == sequenceRange(1, 4));
+    customAssert(feed.metrics().duplicates == 2);
+    customAssert(feed.metrics().reordered == 1);
+    customAssert(feed.metrics().recoveries == 0);
+}
+
+void testSequencedFeedRecoversGap()
+{
+    RetransmitServer server;
+    for (uint64_t seq = 1; seq <= 20; ++seq) {
+        server.record(seq, sequencedFrames({seq}));
+    }
+
+    // Every backend, since the replay connect is finished through each one's writable watch
+    for (Backend backend : {Backend::Epoll, Backend::IoUring, Backend::Spin}) {
+        auto             loop = makeReceiveLoop(backend);
+        vector<uint64_t> seen;
+        SequencedFeed    feed(
+            *loop,
+            server.port(),
+            [&](const Buffer::Header& h, const Buffer::Payload&) {
+                seen.push_back(h.getSequence());
+            },
+            nullptr,
+            64,
+            4);
+
+        // A second, healthy connection shares the loop while the first one recovers
+        int    other = 0;
+        Buffer otherParser(4096, 1 << 20, [&](const Buffer::Header&, const Buffer::Payload&) {
+            other++;
+        });
+
+        int live[2], healthy[2];
+        customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, live) == 0);
+        customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, healthy) == 0);
+        vector<uint64_t> sent = {1, 2};
+        for (uint64_t seq = 6; seq <= 20; ++seq) {
+            sent.push_back(seq);
+        }
+        string frames = sequencedFrames(sent);
+        send(live[1], frames.data(), frames.size(), 0);
+        string otherFrames = sequencedFrames(sequenceRange(1, 10));
+        send(healthy[1], otherFrames.data(), otherFrames.size(), 0);
+        close(live[1]);
+        close(healthy[1]);
+
+        loop->addConnection(live[0], feed.liveParser());
+        loop->addConnection(healthy[0], otherParser);
+        loop->run();
+        close(live[0]);
+        close(healthy[0]);
+
+        customAssert(seen == sequenceRange(1, 20));
+        customAssert(feed.metrics().recoveries == 1);
+        customAssert(feed.metrics().failed == 0);
+        customAssert(!feed.recovering());
+        customAssert(other == 10);
+    }
+}
+
+size_t openDescriptors()
+{
+    size_t count = 0;
+    for (int fd = 0; fd < 4096; ++fd) {
+        count += fcntl(fd, F_GETFD) != -1;
+    }
+    return count;
+}
+
+// A retransmit server that is down makes recovery fail: counted, no exception out of the loop,
+// no leaked socket, and the live and healthy connections carry on
+void testSequencedFeedRecoveryFailureIsCounted()
+{
+    int port = 0;
+    close(createListener(1, port)); // Nothing listens there any more
+
+    for (Backend backend : {Backend::Epoll, Backend::IoUring, Backend::Spin}) {
+        size_t descriptors = openDescriptors();
+        {
+            auto             loop = makeReceiveLoop(backend, false);
+            vector<uint64_t> seen;
+            SequencedFeed    feed(
+                *loop,
+                port,
+                [&](const Buffer::Header& h, const Buffer::Payload&) {
+                    seen.push_back(h.getSequence());
+                },
+                nullptr,
+                64,
+                4);
+            int    other = 0;
+            Buffer otherParser(4096, 1 << 20, [&](const Buffer::Header&, const Buffer::Payload&) {
+                other++;
+            });
+
+            int live[2], healthy[2];
+            customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, live) == 0);
+            customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, healthy) == 0);
+            vector<uint64_t> sent = {1, 2};
+            for (uint64_t seq = 6; seq <= 30; ++seq) {
+                sent.push_back(seq);
+            }
+            string frames = sequencedFrames(sent);
+            send(live[1], frames.data(), frames.size(), 0);
+            string otherFrames = sequencedFrames(sequenceRange(1, 10));
+            send(healthy[1], otherFrames.data(), otherFrames.size(), 0);
+            close(live[1]);
+            close(healthy[1]);
+
+            loop->addConnection(live[0], feed.liveParser());
+            loop->addConnection(healthy[0], otherParser);
+            loop->run();
+            close(live[0]);
+            close(healthy[0]);
+
+            customAssert(seen == sequenceRange(1, 2));
+            customAssert(feed.metrics().recoveries >= 1);
+            customAssert(feed.metrics().failed == feed.metrics().recoveries);
+            customAssert(!feed.recovering());
+            customAssert(other == 10);
+        }
+        customAssert(openDescriptors() == descriptors);
+    }
+}
+
+void testSequencedFeedLoadsSnapshot()
+{
+    RetransmitServer server;
+    for (uint64_t seq = 1; seq <= 12; ++seq) {
+        server.record(seq, sequencedFrames({seq}));
+    }
+    server.snapshot(8, "state@8"); // History before 9 is gone
+
+    EventLoop        loop;
+    vector<uint64_t> seen;
+    string           snapshotState;
+    SequencedFeed    feed(
+        loop,
+        server.port(),
+        [&](const Buffer::Header& h, const Buffer::Payload&) { seen.push_back(h.getSequence()); },
+        [&](uint64_t seq, string_view state) {
+            customAssert(seq == 8);
+            snapshotState = string(state);
+        },
+        64,
+        3);
+
+    int live[2];
+    customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, live) == 0);
+    string frames = sequencedFrames({1, 2, 10, 11, 12});
+    send(live[1], frames.data(), frames.size(), 0);
+    close(live[1]);
+    loop.addConnection(live[0], feed.liveParser());
+    loop.run();
+    close(live[0]);
+
+    customAssert(snapshotState == "state@8");
+    customAssert(seen == vector<uint64_t>({1, 2, 9, 10, 11, 12}));
+    customAssert(feed.nextSequence() == 13);
+    customAssert(feed.metrics().snapshots == 1);
+}
+
+void testSimulatorRoundTripWithSplitFrames()
+{
+    // Tiny random chunks split headers and payloads across reads; any framing mismatch between
+    // writer and reader (such as a wrong header size) shows up as lost or unknown messages
+    SimulatorConfig config;
+    config.messages   = 2000;
+    config.burstSize  = 16;
+    config.maxPayload = 48;
+    config.maxChunk   = 7;
+    FeedSimulator simulator(config);
+    simulator.start();
+
+    CountingHandler counter;
+    Buffer          buffer(4096, 1 << 20, countingHandler(counter));
+    EventLoop       loop;
+    int             socket = createSocket(simulator.port());
+    loop.addConnection(socket, buffer);
+    loop.run();
+    simulator.join();
+    closeSocket(socket);
+
+    customAssert(counter.messages == config.messages);
+    customAssert(counter.unknown == 0);
+    customAssert(counter.outOfOrder == 0);
+    customAssert(counter.lastSequence == config.messages);
+}
+
+void testSimulatorPacesRate()
+{
+    SimulatorConfig config;
+    config.messages          = 100;
+    config.messagesPerSecond = 1000;
+    config.burstSize         = 10;
+    FeedSimulator simulator(config);
+
+    auto start = chrono::steady_clock::now();
+    simulator.start();
+    int             socket = createSocket(simulator.port());
+    CountingHandler counter;
+    Buffer          buffer(4096, 1 << 20, countingHandler(counter));
+    buffer.recvData(socket);
+    simulator.join();
+    closeSocket(socket);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    customAssert(counter.messages == 100);
+    customAssert(seconds >= 0.09); // The last burst is due at 100ms
+}
+
+void testSimulatorReportsDroppedClient()
+{
+    SimulatorConfig config;
+    config.messages  = 1000000;
+    config.burstSize = 1024;
+    FeedSimulator simulator(config);
+    simulator.start();
+
+    // A zero linger close resets the connection, so the simulator's next send fails
+    int    socket = createSocket(simulator.port());
+    linger reset{1, 0};
+    setsockopt(socket, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    close(socket);
+
+    bool threw = false;
+    try {
+        simulator.join();
+    } catch (const runtime_error&) {
+        threw = true;
+    }
+    customAssert(threw);
+    simulator.join(); // The error is reported once
+}
+
+inline int64_t realtimeNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+void testSpinLoopReceivesTimestampedMessages()
+{
+    SimulatorConfig config;
+    config.messages  = 500;
+    config.burstSize = 8;
+    config.maxChunk  = 50;
+    FeedSimulator simulator(config);
+    simulator.start();
+
+    // Pin to a core this process may use, and only on the loop's own thread so the test thread
+    // keeps its affinity
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    customAssert(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    SpinConfig spin;
+    spin.cpu = 0;
+    while (!CPU_ISSET(spin.cpu, &allowed)) {
+        spin.cpu++;
+    }
+    SpinLoop  loop(spin);
+    int64_t   startNs  = realtimeNs();
+    uint64_t  received = 0;
+    uint64_t  stamped  = 0;
+    bool      inRange  = true;
+    Buffer    buffer(4096, 1 << 20, [&](const Buffer::Header& header, const Buffer::Payload&) {
+        received++;
+        if (header.receivedNs != 0) { // The first burst may be queued before stamping is on
+            stamped++;
+            inRange = inRange && header.receivedNs >= startNs && header.receivedNs <= realtimeNs();
+        }
+    });
+    int socket = createSocket(simulator.port());
+    buffer.enableTimestamps(socket);
+    loop.addConnection(socket, buffer);
+    exception_ptr error;
+    thread        receiver([&] {
+        try {
+            loop.run();
+        } catch (...) {
+            error = current_exception();
+        }
+    });
+    receiver.join();
+    simulator.join();
+    if (error) {
+        rethrow_exception(error);
+    }
+    closeSocket(socket);
+
+    cpu_set_t after;
+    CPU_ZERO(&after);
+    customAssert(sched_getaffinity(0, sizeof(after), &after) == 0);
+    customAssert(CPU_EQUAL(&allowed, &after));
+    customAssert(received == config.messages);
+    customAssert(stamped >= config.messages - config.burstSize);
+    customAssert(inRange);
+    customAssert(loop.connectionCount() == 0);
+}
+
+void testSpinLoopPollTimesOut()
+{
+    int fds[2];
+    customAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    uint64_t received = 0;
+    Buffer   buffer(4096, 1 << 20, [&](const Buffer::Header&, const Buffer::Payload&) {
+        received++;
+    });
+    SpinLoop loop;
+    loop.addConnection(fds[0], buffer);
+
+    auto start = chrono::steady_clock::now();
+    customAssert(loop.poll(20) == 0);
+    customAssert(chrono::steady_clock::now() - start >= chrono::milliseconds(20));
+
+    string frame = frameMessage(HeartbeatMsg::type, "");
+    customAssert(write(fds[1], frame.data(), frame.size()) == ssize_t(frame.size()));
+    customAssert(loop.poll(1000) == 1);
+    customAssert(received == 1);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void runTests()
+{
+    vector<string> testResults;
+    testResults.push_back(
+        runTest("testRingBufferMirrorsAcrossWrap", testRingBufferMirrorsAcrossWrap));
+    testResults.push_back(
+        runTest("testRingBufferGrowKeepsPending", testRingBufferGrowKeepsPending));
+    testResults.push_back(runTest("testFramingSplitAcrossReads", testFramingSplitAcrossReads));
+    testResults.push_back(runTest("testLargeMessageGrowsBuffer", testLargeMessageGrowsBuffer));
+    testResults.push_back(runTest("testOversizedMessageRejected", testOversizedMessageRejected));
+    testResults.push_back(
+        runTest("testEventLoopMultiplexesConnections", testEventLoopMultiplexesConnections));
+    testResults.push_back(
+        runTest("testEventLoopDropsFailedConnection", testEventLoopDropsFailedConnection));
+    testResults.push_back(runTest("testUringLoopReceivesFrames", testUringLoopReceivesFrames));
+    testResults.push_back(
+        runTest("testUringLoopFailureDoesNotReplay", testUringLoopFailureDoesNotReplay));
+    testResults.push_back(runTest("testReceiveLoopFallback", testReceiveLoopFallback));
+    testResults.push_back(
+        runTest("testDispatcherDecodesTypedMessages", testDispatcherDecodesTypedMessages));
+    testResults.push_back(
+        runTest("testDispatcherUnknownAndTruncated", testDispatcherUnknownAndTruncated));
+    testResults.push_back(runTest("testSpscRingWrapsAndBounds", testSpscRingWrapsAndBounds));
+    testResults.push_back(
+        runTest("testPipelineAppliesToBookAndStats", testPipelineAppliesToBookAndStats));
+    testResults.push_back(runTest("testSequencedFeedReordersAndDropsDuplicates",
+                                  testSequencedFeedReordersAndDropsDuplicates));
+    testResults.push_back(runTest("testSequencedFeedRecoversGap", testSequencedFeedRecoversGap));
+    testResults.push_back(runTest("testSequencedFeedRecoveryFailureIsCounted",
+                                  testSequencedFeedRecoveryFailureIsCounted));
+    testResults.push_back(
+        runTest("testSequencedFeedLoadsSnapshot", testSequencedFeedLoadsSnapshot));
+    testResults.push_back(
+        runTest("testSimulatorRoundTripWithSplitFrames", testSimulatorRoundTripWithSplitFrames));
+    testResults.push_back(runTest("testSimulatorPacesRate", testSimulatorPacesRate));
+    testResults.push_back(
+        runTest("testSimulatorReportsDroppedClient", testSimulatorReportsDroppedClient));
+    testResults.push_back(runTest("testSpinLoopReceivesTimestampedMessages",
+                                  testSpinLoopReceivesTimestampedMessages));
+    testResults.push_back(runTest("testSpinLoopPollTimesOut", testSpinLoopPollTimesOut));
+
+    // Print test results
+    for (const auto& result : testResults) {
+        cout << result << endl;
+    }
+}
+
+// Serve `connections` loopback feeds from one thread while a single receive loop reads them all
+void benchmarkReceiveLoop(Backend backend,
+                          int     connections,
+                          int     messagesPerConnection,
+                          int     payloadSize)
+{
+    int port     = 0;
+    int listener = createListener(connections, port);
+
+    // Server: accept everyone, then interleave batches of frames across the connections
+    thread server([&] {
+        vector<int> peers;
+        for (int i = 0; i < connections; ++i) {
+            peers.push_back(accept(listener, nullptr, nullptr));
+        }
+        const int batch = 64;
+        string    frames;
+        for (int i = 0; i < batch; ++i) {
+            frames += frameMessage(1, string(payloadSize, 'x'));
+        }
+        for (int sent = 0; sent < messagesPerConnection; sent += batch) {
+            size_t count = min(batch, messagesPerConnection - sent);
+            size_t bytes = count * (frameHeaderSize + payloadSize);
+            for (int peer : peers) {
+                for (size_t off = 0; off < bytes;) {
+                    ssize_t n = send(peer, frames.data() + off, bytes - off, 0);
+                    if (n <= 0) {
+                        break;
+                    }
+                    off += n;
+                }
+            }
+        }
+        for (int peer : peers) {
+            close(peer);
+        }
+    });
+
+    long long                  received = 0;
+    vector<int>                sockets;
+    vector<unique_ptr<Buffer>> parsers;
+    auto                       loop = makeReceiveLoop(backend);
+    for (int i = 0; i < connections; ++i) {
+        sockets.push_back(createSocket(port));
+        parsers.push_back(make_unique<Buffer>(
+            64 * 1024, 1 << 20, [&](const Buffer::Header&, const Buffer::Payload&) {
+                received++;
+            }));
+        loop->addConnection(sockets.back(), *parsers.back());
+    }
+
+    auto start = chrono::steady_clock::now();
+    loop->run();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    server.join();
+    for (int socket : sockets) {
+        closeSocket(socket);
+    }
+    closeSocket(listener);
+
+    cout << "connections: " << connections << ", messages: " << received << ", seconds: " << seconds
+         << ", msgs/sec: " << received / seconds
+         << ", MB/sec: " << received * double(frameHeaderSize + payloadSize) / seconds / 1e6
+         << endl;
+}
+
+void printStageMetrics(const string& stage, const StageMetrics& metrics)
+{
+    cout << stage << ": processed " << metrics.processed << ", max depth " << metrics.maxDepth
+         << ", stalls " << metrics.stalls << ", latency ns p50<=" << metrics.latencyPercentileNs(50)
+         << " p99<=" << metrics.latencyPercentileNs(99)
+         << " p99.9<=" << metrics.latencyPercentileNs(99.9) << " max " << metrics.maxLatencyNs
+         << endl;
+}
+
+// Stream a mix of orders, cancels and trades over loopback through the full feed pipeline
+void benchmarkPipeline(int messages)
+{
+    SimulatorConfig config;
+    config.messages   = messages;
+    config.burstSize  = 1024;
+    config.maxPayload = 0;
+    FeedSimulator simulator(config);
+    simulator.start();
+
+    OrderBook  book;
+    MarketData marketData;
+    book.verbose = false;
+    FeedPipeline pipeline(book, marketData);
+    Buffer       buffer(64 * 1024, 1 << 20, FeedDispatcher<FeedPipeline>(pipeline));
+    EventLoop    loop;
+    int          socket = createSocket(simulator.port());
+    loop.addConnection(socket, buffer);
+
+    pipeline.start();
+    auto start = chrono::steady_clock::now();
+    loop.run();
+    pipeline.stop();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    simulator.join();
+    closeSocket(socket);
+
+    cout << "messages: " << messages << ", seconds: " << seconds
+         << ", msgs/sec: " << messages / seconds << endl;
+    printStageMetrics("book", pipeline.bookMetrics);
+    printStageMetrics("ticks", pipeline.tickMetrics);
+}
+
+// Reader throughput over loopback from the simulator, then pure parse cost from memory
+void benchmarkReader(const SimulatorConfig& config)
+{
+    FeedSimulator simulator(config);
+    simulator.start();
+
+    CountingHandler counter;
+    Buffer          buffer(64 * 1024, 1 << 20, countingHandler(counter));
+    EventLoop       loop;
+    int             socket = createSocket(simulator.port());
+    loop.addConnection(socket, buffer);
+
+    auto start = chrono::steady_clock::now();
+    loop.run();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    simulator.join();
+    closeSocket(socket);
+
+    cout << "loopback: messages " << counter.messages << ", seconds " << seconds << ", msgs/sec "
+         << counter.messages / seconds << ", MB/sec " << simulator.bytesSent() / seconds / 1e6
+         << ", unknown " << counter.unknown << ", out of order " << counter.outOfOrder << endl;
+    if (counter.messages != config.messages || counter.unknown || counter.outOfOrder) {
+        throw runtime_error("Reader lost or misparsed messages");
+    }
+
+    // Same bytes straight from memory, in the same chunk sizes the socket would deliver
+    string          bytes = FeedGenerator(config).all();
+    CountingHandler parsed;
+    Buffer          parser(64 * 1024, 1 << 20, countingHandler(parsed));
+    size_t          chunk = config.maxChunk > 0 ? config.maxChunk : 64 * 1024;
+    start                 = chrono::steady_clock::now();
+    for (size_t off = 0; off < bytes.size(); off += chunk) {
+        parser.feed(bytes.data() + off, min(chunk, bytes.size() - off));
+    }
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "parse only: messages " << parsed.messages << ", ns/message "
+         << seconds * 1e9 / parsed.messages << ", MB/sec " << bytes.size() / seconds / 1e6 << endl;
+}
+
+// Kernel-receive-to-handler latency of a paced feed, which is what spinning saves over sleeping
+// in epoll_wait. Only meaningful when the receiving core is not shared with the sender.
+void benchmarkLatency(Backend backend, const SimulatorConfig& config, int cpu)
+{
+    FeedSimulator simulator(config);
+    simulator.start();
+
+    SpinConfig spin;
+    spin.cpu = cpu;
+    unique_ptr<ReceiveLoop> loop;
+    if (backend == Backend::Spin) {
+        loop = make_unique<SpinLoop>(spin);
+    } else {
+        loop = makeReceiveLoop(backend);
+    }
+
+    StageMetrics metrics;
+    Buffer buffer(64 * 1024, 1 << 20, [&](const Buffer::Header& header, const Buffer::Payload&) {
+        if (header.receivedNs != 0) {
+            metrics.recordLatency(max<int64_t>(realtimeNs() - header.receivedNs, 0));
+        }
+    });
+    int socket = createSocket(simulator.port());
+    buffer.enableTimestamps(socket);
+    loop->addConnection(socket, buffer);
+    loop->run();
+    simulator.join();
+    closeSocket(socket);
+    printStageMetrics(backend == Backend::Spin ? "spin" : "epoll", metrics);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && string(argv[1]) == "--test") {
+        runTests();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-loop") {
+        int connections = argc > 2 ? stoi(argv[2]) : 200;
+        int messages    = argc > 3 ? stoi(argv[3]) : 10000;
+        Backend backend = Backend::Epoll;
+        if (argc > 4 && string(argv[4]) == "uring") {
+            backend = Backend::IoUring;
+        }
+        benchmarkReceiveLoop(backend, connections, messages, 64);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        SimulatorConfig config;
+        config.messages          = argc > 2 ? stoull(argv[2]) : 1000000;
+        config.messagesPerSecond = argc > 3 ? stod(argv[3]) : 0;
+        config.maxChunk          = argc > 4 ? stoul(argv[4]) : 0;
+        try {
+            benchmarkReader(config);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--simulate") {
+        // Serve one client on the port the default mode connects to
+        SimulatorConfig config;
+        config.messages          = argc > 2 ? stoull(argv[2]) : 1000;
+        config.messagesPerSecond = argc > 3 ? stod(argv[3]) : 100;
+        FeedSimulator(config, 8080).serve();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-latency") {
+        Backend backend = argc > 2 && string(argv[2]) == "spin" ? Backend::Spin : Backend::Epoll;
+        SimulatorConfig config;
+        config.messages          = argc > 3 ? stoull(argv[3]) : 20000;
+        config.messagesPerSecond = argc > 4 ? stod(argv[4]) : 10000;
+        config.burstSize         = 1;
+        benchmarkLatency(backend, config, argc > 5 ? stoi(argv[5]) : -1);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-pipeline") {
+        benchmarkPipeline(argc > 2 ? stoi(argv[2]) : 1000000);
+        return 0;
+    }
+
     try {
         int socket = createSocket();
         if (socket < 0) {
             throw runtime_error("Error creating socket");
         }
 
-        Buffer buffer(1024);
+        FeedPrinter printer;
+        Buffer      buffer(1024, 1 << 20, FeedDispatcher<FeedPrinter>(printer));
         buffer.recvData(socket);
         closeSocket(socket);
     } catch (const exception& e) {
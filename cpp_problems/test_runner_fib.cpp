@@ -1,25 +1,267 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include "test_runner.h"
 
 using namespace std;
 
-// Dynamic programming implementation of Fibonacci sequence
+// Every Fibonacci number that fits in 64 bits, F(0) through F(93), built at compile time so
+// there is no lazy initialisation for concurrent callers to race on
+constexpr array<unsigned long long, 94> fibTable = [] {
+    array<unsigned long long, 94> table{};
+    table[1] = 1;
+    for (size_t i = 2; i < table.size(); ++i) {
+        table[i] = table[i - 1] + table[i - 2];
+    }
+    return table;
+}();
+
+// Largest Fibonacci number storable in unsigned long long is F(93); past it use bigFib
 unsigned long long calcFib(int n)
 {
-    const int                size = 93;        // Largest Fibonacci number storable in long long
-    static vector<long long> dp(size + 1, -1); // Static storage for already calculated figures
-    if (dp[0] == -1)
-        dp[0] = 0; // Initialize base case
-    if (dp[1] == -1)
-        dp[1] = 1; // Initialize base case
-    if (dp[n] != -1)
-        return dp[n];
-    for (int i = 2; i <= n; ++i)
-        if (dp[i] == -1)
-            dp[i] = dp[i - 1] + dp[i - 2];
-
-    return dp[n];
+    if (n < 0 || n >= int(fibTable.size())) {
+        throw out_of_range("calcFib: n must be in [0, 93], use bigFib beyond");
+    }
+    return fibTable[n];
+}
+
+// Fast doubling: {F(n), F(n + 1)} in O(log n) steps from
+//   F(2k) = F(k) * (2 F(k + 1) - F(k)),   F(2k + 1) = F(k)^2 + F(k + 1)^2
+// Number needs +, - and *. For unsigned integers the result is exact modulo 2^bits.
+template <typename Number>
+constexpr pair<Number, Number> fibPair(uint64_t n)
+{
+    Number a = 0, b = 1; // F(k), F(k + 1) for k = the bits of n consumed so far
+    for (int i = bit_width(n) - 1; i >= 0; --i) {
+        Number even = a * (b + b - a);
+        Number odd  = a * a + b * b;
+        if (n >> i & 1) {
+            a = odd;
+            b = even + odd;
+        } else {
+            a = even;
+            b = odd;
+        }
+    }
+    return {a, b};
+}
+
+static_assert(fibPair<uint64_t>(93).first == fibTable[93]);
+
+// Arbitrary-precision unsigned integer: little-endian base 2^32 limbs without leading zeros,
+// so zero has no limbs
+class BigUnsigned
+{
+   public:
+    BigUnsigned(uint64_t value = 0)
+    {
+        for (; value; value >>= 32) {
+            limbs_.push_back(uint32_t(value));
+        }
+    }
+
+    size_t limbCount() const
+    {
+        return limbs_.size();
+    }
+
+    bool operator==(const BigUnsigned& other) const = default;
+
+    BigUnsigned& operator+=(const BigUnsigned& other)
+    {
+        limbs_.resize(max(limbs_.size(), other.limbs_.size()) + 1);
+        addAt(limbs_, other.limbs_.data(), other.limbs_.size(), 0);
+        trim(limbs_);
+        return *this;
+    }
+
+    BigUnsigned& operator-=(const BigUnsigned& other)
+    {
+        if (*this < other) {
+            throw out_of_range("BigUnsigned: subtraction would go negative");
+        }
+        subtract(limbs_, other.limbs_);
+        trim(limbs_);
+        return *this;
+    }
+
+    bool operator<(const BigUnsigned& other) const
+    {
+        if (limbs_.size() != other.limbs_.size()) {
+            return limbs_.size() < other.limbs_.size();
+        }
+        return lexicographical_compare(limbs_.rbegin(), limbs_.rend(), other.limbs_.rbegin(),
+                                       other.limbs_.rend());
+    }
+
+    BigUnsigned operator+(const BigUnsigned& other) const
+    {
+        return BigUnsigned(*this) += other;
+    }
+
+    BigUnsigned operator-(const BigUnsigned& other) const
+    {
+        return BigUnsigned(*this) -= other;
+    }
+
+    BigUnsigned operator*(const BigUnsigned& other) const
+    {
+        return multiply(*this, other);
+    }
+
+    // Karatsuba above karatsubaThreshold limbs, schoolbook below it (SIZE_MAX: always)
+    static BigUnsigned multiply(const BigUnsigned& a, const BigUnsigned& b,
+                                size_t karatsubaThreshold = 32)
+    {
+        BigUnsigned result;
+        result.limbs_ = multiplyLimbs(a.limbs_.data(), a.limbs_.size(), b.limbs_.data(),
+                                      b.limbs_.size(), max<size_t>(karatsubaThreshold, 2));
+        return result;
+    }
+
+    // Decimal digits, peeling off 9 at a time by dividing by 10^9; quadratic in the length
+    string toString() const
+    {
+        if (limbs_.empty()) {
+            return "0";
+        }
+        vector<uint32_t> rest = limbs_;
+        vector<uint32_t> chunks; // Base 10^9, least significant first
+        while (!rest.empty()) {
+            uint64_t remainder = 0;
+            for (size_t i = rest.size(); i-- > 0;) {
+                uint64_t current = remainder << 32 | rest[i];
+                rest[i]          = uint32_t(current / 1000000000);
+                remainder        = current % 1000000000;
+            }
+            chunks.push_back(uint32_t(remainder));
+            trim(rest);
+        }
+        string digits = to_string(chunks.back());
+        for (size_t i = chunks.size() - 1; i-- > 0;) {
+            string chunk = to_string(chunks[i]);
+            digits += string(9 - chunk.size(), '0') + chunk;
+        }
+        return digits;
+    }
+
+   private:
+    using Limbs = vector<uint32_t>;
+
+    static void trim(Limbs& limbs)
+    {
+        while (!limbs.empty() && limbs.back() == 0) {
+            limbs.pop_back();
+        }
+    }
+
+    // acc += x * 2^(32 * shift); acc must have room for the final carry
+    static void addAt(Limbs& acc, const uint32_t* x, size_t n, size_t shift)
+    {
+        uint64_t carry = 0;
+        size_t   i     = 0;
+        for (; i < n; ++i) {
+            carry += uint64_t(acc[shift + i]) + x[i];
+            acc[shift + i] = uint32_t(carry);
+            carry >>= 32;
+        }
+        for (; carry; ++i) {
+            carry += acc[shift + i];
+            acc[shift + i] = uint32_t(carry);
+            carry >>= 32;
+        }
+    }
+
+    // a -= b for b <= a, leaving any leading zeros in a
+    static void subtract(Limbs& a, const Limbs& b)
+    {
+        int64_t borrow = 0;
+        for (size_t i = 0; i < a.size() && (i < b.size() || borrow); ++i) {
+            int64_t current = int64_t(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+            borrow          = current < 0;
+            a[i]            = uint32_t(current + (borrow << 32));
+        }
+    }
+
+    static Limbs multiplyLimbs(const uint32_t* a, size_t n, const uint32_t* b, size_t m,
+                               size_t threshold)
+    {
+        while (n && a[n - 1] == 0) {
+            n--;
+        }
+        while (m && b[m - 1] == 0) {
+            m--;
+        }
+        if (n < m) {
+            swap(a, b);
+            swap(n, m);
+        }
+        if (m == 0) {
+            return {};
+        }
+        Limbs result(n + m + 1, 0);
+        if (m < threshold) {
+            for (size_t j = 0; j < m; ++j) {
+                uint64_t carry = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    carry += uint64_t(a[i]) * b[j] + result[i + j];
+                    result[i + j] = uint32_t(carry);
+                    carry >>= 32;
+                }
+                result[n + j] = uint32_t(carry);
+            }
+        } else if (n >= 2 * m) {
+            // Unbalanced: multiply b by m-limb slices of a so each product stays balanced
+            for (size_t at = 0; at < n; at += m) {
+                Limbs part = multiplyLimbs(a + at, min(m, n - at), b, m, threshold);
+                addAt(result, part.data(), part.size(), at);
+            }
+        } else {
+            // a = a1 B^h + a0, b = b1 B^h + b0 with B = 2^32; three half-size products
+            // z0 = a0 b0, z2 = a1 b1, z1 = (a0 + a1)(b0 + b1) - z0 - z2
+            size_t h     = n / 2; // m > h because n < 2m
+            Limbs  sumA  = sumHalves(a, h, n), sumB = sumHalves(b, h, m);
+            Limbs  z0    = multiplyLimbs(a, h, b, h, threshold);
+            Limbs  z2    = multiplyLimbs(a + h, n - h, b + h, m - h, threshold);
+            Limbs  z1    = multiplyLimbs(sumA.data(), sumA.size(), sumB.data(), sumB.size(),
+                                         threshold);
+            subtract(z1, z0);
+            subtract(z1, z2);
+            trim(z1);
+            addAt(result, z0.data(), z0.size(), 0);
+            addAt(result, z1.data(), z1.size(), h);
+            addAt(result, z2.data(), z2.size(), 2 * h);
+        }
+        trim(result);
+        return result;
+    }
+
+    // x[0, h) + x[h, n) as its own number
+    static Limbs sumHalves(const uint32_t* x, size_t h, size_t n)
+    {
+        Limbs sum(max(h, n - h) + 1, 0);
+        copy(x, x + h, sum.begin());
+        addAt(sum, x + h, n - h, 0);
+        return sum;
+    }
+
+    Limbs limbs_;
+};
+
+// F(n) for any n: the table up to F(93), fast doubling over big integers past it
+BigUnsigned bigFib(uint64_t n)
+{
+    if (n < fibTable.size()) {
+        return fibTable[n];
+    }
+    return fibPair<BigUnsigned>(n).first;
 }
 
 // dummy test function example
@@ -61,6 +303,81 @@ void testCalcFib()
     customAssert(calcFib(92) == 7540113804746346429);
     // Test case 11: largest fib number
     customAssert(calcFib(93) == 12200160415121876738ULL);
+    // Test case 12: past the 64-bit range and negative n are errors, not overflow
+    for (int n : {94, 1000, -1}) {
+        bool threw = false;
+        try {
+            calcFib(n);
+        } catch (const out_of_range&) {
+            threw = true;
+        }
+        customAssert(threw);
+    }
+}
+
+// Fast doubling and the big-integer path against the table and against plain addition
+void testFastDoubling()
+{
+    for (uint64_t n = 0; n < fibTable.size(); ++n) {
+        customAssert(fibPair<uint64_t>(n).first == fibTable[n]);
+        customAssert(bigFib(n).toString() == to_string(fibTable[n]));
+    }
+    customAssert(bigFib(100).toString() == "354224848179261915075");
+
+    BigUnsigned previous = 0, current = 1; // F(n), F(n + 1)
+    for (uint64_t n = 0; n <= 3000; ++n) {
+        if (n == 94 || n == 95 || n == 128 || n == 1000 || n == 2047 || n == 3000) {
+            customAssert(bigFib(n) == previous);
+        }
+        BigUnsigned next = previous + current;
+        previous         = current;
+        current          = next;
+    }
+
+    // Cassini: F(n - 1) F(n + 1) - F(n)^2 = (-1)^n, with operands well past the threshold
+    for (uint64_t n : {20000, 20001}) {
+        BigUnsigned left = bigFib(n - 1) * bigFib(n + 1), right = bigFib(n) * bigFib(n);
+        customAssert(n % 2 ? left + 1 == right : left == right + 1);
+    }
+}
+
+// Karatsuba at every depth against schoolbook, on balanced and lopsided operands with long
+// carry chains
+void testKaratsuba()
+{
+    mt19937           rng(7);
+    const BigUnsigned base = 1ull << 32;
+    auto              random = [&](size_t limbs) {
+        BigUnsigned value = 0;
+        for (size_t i = 0; i < limbs; ++i) {
+            uint32_t limb = rng() % 4 == 0 ? (rng() % 2 ? UINT32_MAX : 0) : rng();
+            value         = value * base + limb;
+        }
+        return value;
+    };
+    for (int round = 0; round < 60; ++round) {
+        BigUnsigned a = random(1 + rng() % 200), b = random(1 + rng() % (round % 3 ? 200 : 20));
+        BigUnsigned schoolbook = BigUnsigned::multiply(a, b, SIZE_MAX);
+        customAssert(BigUnsigned::multiply(a, b, 2) == schoolbook);
+        customAssert(BigUnsigned::multiply(b, a, 5) == schoolbook);
+        customAssert(a * b == schoolbook && (schoolbook - a * b) == 0);
+    }
+    BigUnsigned ones = 1;
+    for (int i = 0; i < 150; ++i) {
+        ones = ones * base;
+    }
+    ones -= 1; // 150 limbs of all ones
+    BigUnsigned square = BigUnsigned::multiply(ones, ones, 2);
+    customAssert(square == BigUnsigned::multiply(ones, ones, SIZE_MAX));
+    customAssert(BigUnsigned(0) * ones == 0 && ones * 1 == ones);
+
+    bool threw = false;
+    try {
+        BigUnsigned(5) - BigUnsigned(6);
+    } catch (const out_of_range&) {
+        threw = true;
+    }
+    customAssert(threw);
 }
 
 // Testing function runner
@@ -72,6 +389,8 @@ void runTests()
     testResults.push_back(runTest("testFunction", testFunction));
     testResults.push_back(runTest("testTwo", testTwo));
     testResults.push_back(runTest("testCalcFib", testCalcFib));
+    testResults.push_back(runTest("testFastDoubling", testFastDoubling));
+    testResults.push_back(runTest("testKaratsuba", testKaratsuba));
 
     // Print test results
     for (const auto& result : testResults) {
@@ -79,8 +398,52 @@ void runTests()
     }
 }
 
-int main()
+// Needs n >= 1, since it also multiplies by F(n - 1)
+void benchmark(uint64_t n)
+{
+    auto start = chrono::steady_clock::now();
+    auto since = [&start] {
+        double ms = chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e3;
+        start     = chrono::steady_clock::now();
+        return ms;
+    };
+
+    BigUnsigned doubled = bigFib(n);
+    double      fast    = since();
+    cout << "F(" << n << "): " << doubled.limbCount() << " limbs, fast doubling ms " << fast;
+    if (n <= 300000) {
+        BigUnsigned previous = 0, current = 1;
+        for (uint64_t i = 0; i < n; ++i) {
+            BigUnsigned next = previous + current;
+            previous         = move(current);
+            current          = move(next);
+        }
+        double added = since();
+        cout << ", repeated addition ms " << added << (previous == doubled ? "" : " MISMATCH");
+    }
+    cout << endl;
+
+    BigUnsigned a = doubled, b = bigFib(n - 1);
+    since();
+    BigUnsigned karatsuba  = a * b;
+    double      split      = since();
+    BigUnsigned plain      = BigUnsigned::multiply(a, b, SIZE_MAX);
+    double      schoolbook = since();
+    cout << "F(n) * F(n - 1): karatsuba ms " << split << ", schoolbook ms " << schoolbook
+         << (karatsuba == plain ? "" : " MISMATCH") << endl;
+}
+
+int main(int argc, char* argv[])
 {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        uint64_t n = argc > 2 ? stoull(argv[2]) : 1000000;
+        if (n < 1) {
+            cerr << "--bench needs n >= 1" << endl;
+            return 1;
+        }
+        benchmark(n);
+        return 0;
+    }
     runTests();
     return 0;
 }